@@ -0,0 +1,202 @@
+#include "../src/TLSF.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <algorithm>
+
+// 256 MB, same as the MemoryAllocator chunks
+#define BENCHMARK_CHUNK_SIZE (uint64_t)268435456
+
+// Previous first-fit linked list sub-allocator, kept here for comparison
+struct ListBlock {
+	ListBlock* next;
+
+	uint64_t offset;
+	uint64_t size;
+	bool inUse;
+};
+
+struct ListChunk {
+	ListBlock* head;
+
+	ListChunk(uint64_t size) {
+		head = new ListBlock();
+		head->offset = 0;
+		head->size = size;
+		head->inUse = false;
+		head->next = nullptr;
+	}
+
+	~ListChunk() {
+		ListBlock* curr;
+		while (head) {
+			curr = head;
+			head = head->next;
+			delete curr;
+		}
+	}
+
+	uint64_t allocate(uint64_t allocationSize, uint64_t alignment) {
+		ListBlock* curr = head;
+		while (curr) {
+			if (!curr->inUse) {
+				uint64_t actualSize = curr->size;
+				if (curr->offset % alignment != 0) {
+					actualSize -= alignment - curr->offset % alignment;
+				}
+
+				if (actualSize >= allocationSize) {
+					curr->size = actualSize;
+					if (curr->offset % alignment != 0) {
+						curr->offset += alignment - curr->offset % alignment;
+					}
+
+					if (curr->size == allocationSize) {
+						curr->inUse = true;
+						return curr->offset;
+					}
+
+					ListBlock* newBlock = new ListBlock();
+					newBlock->inUse = false;
+					newBlock->offset = curr->offset + allocationSize;
+					newBlock->size = curr->size - allocationSize;
+					newBlock->next = curr->next;
+
+					curr->size = allocationSize;
+					curr->inUse = true;
+					curr->next = newBlock;
+
+					return curr->offset;
+				}
+			}
+			curr = curr->next;
+		}
+
+		return (uint64_t)-1;
+	}
+};
+
+struct Request {
+	uint64_t size;
+	uint64_t alignment;
+};
+
+// Mix of small buffers (uniform buffers, meshes) and textures
+std::vector<Request> generateRequests(size_t count, uint32_t seed) {
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution<int> kind(0, 99);
+	std::uniform_int_distribution<uint64_t> smallSize(64, 4096);
+	std::uniform_int_distribution<uint64_t> mediumSize(4096, 65536);
+	std::uniform_int_distribution<int> textureLevel(6, 10);
+
+	std::vector<Request> requests(count);
+	for (Request& request : requests) {
+		int k = kind(rng);
+		if (k < 60) {
+			request.size = smallSize(rng);
+			request.alignment = 256;
+		}
+		else if (k < 90) {
+			request.size = mediumSize(rng);
+			request.alignment = 16;
+		}
+		else {
+			uint64_t side = 1ULL << textureLevel(rng);
+			request.size = side * side * 4;
+			request.alignment = 65536;
+		}
+	}
+
+	return requests;
+}
+
+double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Allocations go to the first chunk that can hold them, a new chunk is created otherwise
+template <typename ChunkType, typename AllocateFunction>
+size_t allocateAll(std::vector<ChunkType*>& chunks, const std::vector<Request>& requests, AllocateFunction allocateFunction) {
+	size_t failures = 0;
+	for (const Request& request : requests) {
+		bool allocated = false;
+		for (ChunkType* chunk : chunks) {
+			if (allocateFunction(chunk, request)) {
+				allocated = true;
+				break;
+			}
+		}
+		if (!allocated) {
+			chunks.push_back(new ChunkType(std::max(BENCHMARK_CHUNK_SIZE, request.size)));
+			if (!allocateFunction(chunks.back(), request)) {
+				failures++;
+			}
+		}
+	}
+
+	return failures;
+}
+
+int main(int argc, char* argv[]) {
+	std::vector<size_t> counts = { 10000, 20000, 50000 };
+	if (argc > 1) {
+		counts = { (size_t)std::stoull(argv[1]) };
+	}
+
+	std::cout << "allocations | list walk (ms) | TLSF (ms) | TLSF churn (ms)" << std::endl;
+	for (size_t count : counts) {
+		std::vector<Request> requests = generateRequests(count, 42);
+
+		// Linked list
+		std::vector<ListChunk*> listChunks;
+		auto start = std::chrono::high_resolution_clock::now();
+		size_t listFailures = allocateAll(listChunks, requests, [](ListChunk* chunk, const Request& request) {
+			return chunk->allocate(request.size, request.alignment) != (uint64_t)-1;
+		});
+		double listTime = elapsedMs(start);
+
+		// TLSF
+		std::vector<TLSF*> tlsfChunks;
+		std::vector<std::pair<TLSF*, Block*>> blocks;
+		blocks.reserve(count);
+		start = std::chrono::high_resolution_clock::now();
+		size_t tlsfFailures = allocateAll(tlsfChunks, requests, [&blocks](TLSF* chunk, const Request& request) {
+			Block* block = chunk->allocate(request.size, request.alignment);
+			if (block) {
+				blocks.push_back({ chunk, block });
+			}
+			return block != nullptr;
+		});
+		double tlsfTime = elapsedMs(start);
+
+		// TLSF, free half of the blocks in random order then allocate them again
+		std::mt19937 rng(7);
+		std::shuffle(blocks.begin(), blocks.end(), rng);
+		size_t half = blocks.size() / 2;
+		start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < half; i++) {
+			blocks[i].first->free(blocks[i].second);
+		}
+		std::vector<Request> churnRequests(requests.begin(), requests.begin() + half);
+		tlsfFailures += allocateAll(tlsfChunks, churnRequests, [](TLSF* chunk, const Request& request) {
+			return chunk->allocate(request.size, request.alignment) != nullptr;
+		});
+		double churnTime = elapsedMs(start);
+
+		std::cout << count << " | " << listTime << " | " << tlsfTime << " | " << churnTime << std::endl;
+		if (listFailures || tlsfFailures) {
+			std::cout << "Failed allocations: list " << listFailures << ", TLSF " << tlsfFailures << std::endl;
+		}
+
+		for (ListChunk* chunk : listChunks) {
+			delete chunk;
+		}
+		for (TLSF* chunk : tlsfChunks) {
+			delete chunk;
+		}
+	}
+
+	return 0;
+}
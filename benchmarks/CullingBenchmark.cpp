@@ -0,0 +1,74 @@
+#include "../src/FrustumCuller.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Box of side 2 * halfSize around the origin, normals pointing inside, seen by a camera at its center
+std::vector<float> boxPlanes(float halfSize) {
+	return {
+		1.0f, 0.0f, 0.0f, halfSize,
+		-1.0f, 0.0f, 0.0f, halfSize,
+		0.0f, 1.0f, 0.0f, halfSize,
+		0.0f, -1.0f, 0.0f, halfSize,
+		0.0f, 0.0f, 1.0f, halfSize,
+		0.0f, 0.0f, -1.0f, halfSize
+	};
+}
+
+int main(int argc, char* argv[]) {
+	std::vector<size_t> counts = { 10000, 100000, 1000000 };
+	if (argc > 1) {
+		counts = { (size_t)std::stoull(argv[1]) };
+	}
+	// Runs of each kernel, the best one is kept
+	const int runs = 20;
+
+	// About a quarter of the spheres are visible
+	std::vector<float> planes = boxPlanes(500.0f);
+
+	std::cout << "Spheres per SIMD instruction: " << FRUSTUM_CULLER_WIDTH << std::endl;
+	std::cout << "spheres | scalar (ms) | SIMD (ms) | scalar (M spheres/s) | SIMD (M spheres/s) | visible" << std::endl;
+	for (size_t count : counts) {
+		std::mt19937 rng(42);
+		std::uniform_real_distribution<float> position(-800.0f, 800.0f);
+		std::uniform_real_distribution<float> radius(0.5f, 10.0f);
+
+		FrustumCuller culler;
+		culler.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			culler.setSphere(i, position(rng), position(rng), position(rng), radius(rng));
+		}
+
+		std::vector<uint8_t> scalarVisible(count);
+		std::vector<uint8_t> simdVisible(count);
+		double scalarTime = 1e30;
+		double simdTime = 1e30;
+		size_t scalarCount = 0;
+		size_t simdCount = 0;
+		for (int run = 0; run < runs; run++) {
+			auto start = std::chrono::high_resolution_clock::now();
+			scalarCount = culler.cullScalar(planes.data(), scalarVisible.data());
+			scalarTime = std::min(scalarTime, elapsedMs(start));
+
+			start = std::chrono::high_resolution_clock::now();
+			simdCount = culler.cull(planes.data(), simdVisible.data());
+			simdTime = std::min(simdTime, elapsedMs(start));
+		}
+
+		std::cout << count << " | " << scalarTime << " | " << simdTime << " | " << count / (scalarTime * 1000.0) << " | " << count / (simdTime * 1000.0) << " | " << simdCount << std::endl;
+		if (scalarCount != simdCount || scalarVisible != simdVisible) {
+			std::cout << "Scalar and SIMD results differ: " << scalarCount << " and " << simdCount << " visible" << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,204 @@
+#include "MockMemoryBackend.h"
+#include <algorithm>
+
+template <typename T>
+static T toHandle(uint64_t value) {
+	return (T)(uintptr_t)value;
+}
+
+template <typename T>
+static uint64_t fromHandle(T handle) {
+	return (uint64_t)(uintptr_t)handle;
+}
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+VkPhysicalDeviceMemoryProperties MockMemoryBackend::getMemoryProperties() {
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	memoryProperties.memoryHeapCount = 3;
+	// 8 GB of video memory, 16 GB of system memory and the 256 MB BAR
+	memoryProperties.memoryHeaps[0].size = 8589934592ULL;
+	memoryProperties.memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+	memoryProperties.memoryHeaps[1].size = 17179869184ULL;
+	memoryProperties.memoryHeaps[1].flags = 0;
+	memoryProperties.memoryHeaps[2].size = 268435456ULL;
+	memoryProperties.memoryHeaps[2].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+
+	memoryProperties.memoryTypeCount = 3;
+	memoryProperties.memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	memoryProperties.memoryTypes[0].heapIndex = 0;
+	memoryProperties.memoryTypes[1].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	memoryProperties.memoryTypes[1].heapIndex = 1;
+	memoryProperties.memoryTypes[2].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	memoryProperties.memoryTypes[2].heapIndex = 2;
+
+	return memoryProperties;
+}
+
+VkPhysicalDeviceLimits MockMemoryBackend::getLimits() {
+	VkPhysicalDeviceLimits limits = {};
+	limits.minUniformBufferOffsetAlignment = 256;
+	limits.minStorageBufferOffsetAlignment = 32;
+	limits.minTexelBufferOffsetAlignment = 16;
+	limits.bufferImageGranularity = 1024;
+	limits.nonCoherentAtomSize = 64;
+	limits.maxMemoryAllocationCount = 4096;
+
+	return limits;
+}
+
+VkBuffer MockMemoryBackend::createBuffer(VkMemoryRequirements memRequirements) {
+	std::lock_guard<std::mutex> lock(mutex);
+	uint64_t handle = newHandle();
+	requirements[handle] = memRequirements;
+
+	return toHandle<VkBuffer>(handle);
+}
+
+VkImage MockMemoryBackend::createImage(VkMemoryRequirements memRequirements) {
+	std::lock_guard<std::mutex> lock(mutex);
+	uint64_t handle = newHandle();
+	requirements[handle] = memRequirements;
+
+	return toHandle<VkImage>(handle);
+}
+
+VkDeviceSize MockMemoryBackend::getAllocatedSize() {
+	return allocatedSize;
+}
+
+VkDeviceSize MockMemoryBackend::getPeakAllocatedSize() {
+	return peakAllocatedSize;
+}
+
+uint32_t MockMemoryBackend::getAllocationCount() {
+	return allocationCount;
+}
+
+VkDeviceSize MockMemoryBackend::getCopiedSize() {
+	return copiedSize;
+}
+
+void MockMemoryBackend::resetPeak() {
+	peakAllocatedSize = allocatedSize;
+	copiedSize = 0;
+}
+
+VkResult MockMemoryBackend::allocateMemory(const VkMemoryAllocateInfo* allocInfo, VkDeviceMemory* memory) {
+	std::lock_guard<std::mutex> lock(mutex);
+	uint64_t handle = newHandle();
+	memorySizes[handle] = allocInfo->allocationSize;
+	allocatedSize += allocInfo->allocationSize;
+	peakAllocatedSize = std::max(peakAllocatedSize, allocatedSize);
+	allocationCount++;
+	*memory = toHandle<VkDeviceMemory>(handle);
+
+	return VK_SUCCESS;
+}
+
+void MockMemoryBackend::freeMemory(VkDeviceMemory memory) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = memorySizes.find(fromHandle(memory));
+	if (it != memorySizes.end()) {
+		allocatedSize -= it->second;
+		allocationCount--;
+		memorySizes.erase(it);
+	}
+}
+
+VkResult MockMemoryBackend::mapMemory(VkDeviceMemory memory, void** data) {
+	// Never dereferenced, the benchmarks do not write in the allocations
+	*data = toHandle<void*>(fromHandle(memory));
+
+	return VK_SUCCESS;
+}
+
+void MockMemoryBackend::unmapMemory(VkDeviceMemory memory) {
+}
+
+VkResult MockMemoryBackend::createBuffer(const VkBufferCreateInfo* bufferInfo, VkBuffer* buffer) {
+	VkMemoryRequirements memRequirements;
+	memRequirements.size = alignUp(bufferInfo->size, 256);
+	memRequirements.alignment = 256;
+	memRequirements.memoryTypeBits = 0x7;
+	*buffer = createBuffer(memRequirements);
+
+	return VK_SUCCESS;
+}
+
+void MockMemoryBackend::destroyBuffer(VkBuffer buffer) {
+	std::lock_guard<std::mutex> lock(mutex);
+	requirements.erase(fromHandle(buffer));
+}
+
+void MockMemoryBackend::getBufferMemoryRequirements(VkBuffer buffer, VkMemoryRequirements* memRequirements) {
+	std::lock_guard<std::mutex> lock(mutex);
+	*memRequirements = requirements[fromHandle(buffer)];
+}
+
+VkResult MockMemoryBackend::bindBufferMemory(VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset) {
+	return VK_SUCCESS;
+}
+
+VkResult MockMemoryBackend::createImage(const VkImageCreateInfo* imageInfo, VkImage* image) {
+	// 4 bytes per texel, a third more for the mip chain
+	VkDeviceSize size = (VkDeviceSize)imageInfo->extent.width * imageInfo->extent.height * imageInfo->extent.depth * imageInfo->arrayLayers * imageInfo->samples * 4;
+	if (imageInfo->mipLevels > 1) {
+		size += size / 3;
+	}
+
+	VkMemoryRequirements memRequirements;
+	memRequirements.alignment = 65536;
+	memRequirements.size = alignUp(size, memRequirements.alignment);
+	memRequirements.memoryTypeBits = 0x5;
+	*image = createImage(memRequirements);
+
+	return VK_SUCCESS;
+}
+
+void MockMemoryBackend::destroyImage(VkImage image) {
+	std::lock_guard<std::mutex> lock(mutex);
+	requirements.erase(fromHandle(image));
+}
+
+void MockMemoryBackend::getImageMemoryRequirements(VkImage image, VkMemoryRequirements* memRequirements) {
+	std::lock_guard<std::mutex> lock(mutex);
+	*memRequirements = requirements[fromHandle(image)];
+}
+
+VkResult MockMemoryBackend::bindImageMemory(VkImage image, VkDeviceMemory memory, VkDeviceSize offset) {
+	return VK_SUCCESS;
+}
+
+bool MockMemoryBackend::prefersDedicatedBuffer(VkBuffer buffer) {
+	return false;
+}
+
+bool MockMemoryBackend::prefersDedicatedImage(VkImage image) {
+	return false;
+}
+
+bool MockMemoryBackend::getMemoryBudget(VkDeviceSize* heapBudgets, VkDeviceSize* heapUsages) {
+	return false;
+}
+
+void MockMemoryBackend::cmdCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy* regions) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (uint32_t i = 0; i < regionCount; i++) {
+		copiedSize += regions[i].size;
+	}
+}
+
+void MockMemoryBackend::cmdCopyImage(VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageCopy* regions) {
+	std::lock_guard<std::mutex> lock(mutex);
+	copiedSize += requirements[fromHandle(srcImage)].size;
+}
+
+void MockMemoryBackend::cmdPipelineBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, uint32_t memoryBarrierCount, const VkMemoryBarrier* memoryBarriers, uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* imageMemoryBarriers) {
+}
+
+uint64_t MockMemoryBackend::newHandle() {
+	return nextHandle++;
+}
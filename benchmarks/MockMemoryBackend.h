@@ -0,0 +1,59 @@
+#pragma once
+#include "../src/MemoryBackend.h"
+#include <unordered_map>
+#include <mutex>
+
+// MemoryBackend without a device, handles are counters and memory is never touched
+// Used to benchmark the MemoryAllocator on machines without a GPU, can be called from several threads
+class MockMemoryBackend : public MemoryBackend {
+public:
+	// Memory types and limits of a typical discrete GPU
+	VkPhysicalDeviceMemoryProperties getMemoryProperties();
+	VkPhysicalDeviceLimits getLimits();
+
+	// Resources with the memory requirements recorded in a trace
+	VkBuffer createBuffer(VkMemoryRequirements memRequirements);
+	VkImage createImage(VkMemoryRequirements memRequirements);
+
+	VkDeviceSize getAllocatedSize();
+	VkDeviceSize getPeakAllocatedSize();
+	uint32_t getAllocationCount();
+	VkDeviceSize getCopiedSize();
+	void resetPeak();
+
+	VkResult allocateMemory(const VkMemoryAllocateInfo* allocInfo, VkDeviceMemory* memory) override;
+	void freeMemory(VkDeviceMemory memory) override;
+	VkResult mapMemory(VkDeviceMemory memory, void** data) override;
+	void unmapMemory(VkDeviceMemory memory) override;
+
+	VkResult createBuffer(const VkBufferCreateInfo* bufferInfo, VkBuffer* buffer) override;
+	void destroyBuffer(VkBuffer buffer) override;
+	void getBufferMemoryRequirements(VkBuffer buffer, VkMemoryRequirements* memRequirements) override;
+	VkResult bindBufferMemory(VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset) override;
+
+	VkResult createImage(const VkImageCreateInfo* imageInfo, VkImage* image) override;
+	void destroyImage(VkImage image) override;
+	void getImageMemoryRequirements(VkImage image, VkMemoryRequirements* memRequirements) override;
+	VkResult bindImageMemory(VkImage image, VkDeviceMemory memory, VkDeviceSize offset) override;
+
+	bool prefersDedicatedBuffer(VkBuffer buffer) override;
+	bool prefersDedicatedImage(VkImage image) override;
+	bool getMemoryBudget(VkDeviceSize* heapBudgets, VkDeviceSize* heapUsages) override;
+
+	void cmdCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy* regions) override;
+	void cmdCopyImage(VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageCopy* regions) override;
+	void cmdPipelineBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, uint32_t memoryBarrierCount, const VkMemoryBarrier* memoryBarriers, uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* imageMemoryBarriers) override;
+private:
+	uint64_t newHandle();
+
+	std::mutex mutex;
+	uint64_t nextHandle = 1;
+	// Memory requirements of the buffers and images, by handle
+	std::unordered_map<uint64_t, VkMemoryRequirements> requirements;
+	std::unordered_map<uint64_t, VkDeviceSize> memorySizes;
+
+	VkDeviceSize allocatedSize = 0;
+	VkDeviceSize peakAllocatedSize = 0;
+	uint32_t allocationCount = 0;
+	VkDeviceSize copiedSize = 0;
+};
@@ -0,0 +1,350 @@
+#include "MockMemoryBackend.h"
+#include "../src/MemoryAllocator.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#define REPLAY_ITERATIONS 20
+// Same budget as the renderer
+#define DEFRAGMENTATION_MAX_BYTES 8388608
+// Allocations done by each thread of the parallel benchmark
+#define THREAD_ALLOCATIONS 200000
+
+// One line of a trace written by MemoryAllocator::startTrace
+// b: buffer sub-allocation, d: buffer bound to its own memory range, i: image, f: free
+struct TraceOperation {
+	char type;
+	uint64_t id;
+	VkDeviceSize size;
+	VkDeviceSize alignment;
+	uint32_t memoryTypeBits;
+	VkBufferUsageFlags usage;
+	VkMemoryPropertyFlags flags;
+	VkImageTiling tiling;
+	bool dedicated;
+};
+
+std::vector<TraceOperation> loadTrace(const std::string& path) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open trace file " + path + "!");
+	}
+
+	std::vector<TraceOperation> trace;
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream stream(line);
+		TraceOperation operation = {};
+		if (!(stream >> operation.type >> operation.id)) {
+			continue;
+		}
+		if (operation.type == 'b') {
+			stream >> operation.size >> operation.usage >> operation.flags;
+		}
+		else if (operation.type == 'd' || operation.type == 'i') {
+			stream >> operation.size >> operation.alignment >> operation.memoryTypeBits >> operation.flags;
+		}
+		if (operation.type == 'i') {
+			int tiling = VK_IMAGE_TILING_OPTIMAL;
+			stream >> tiling >> operation.dedicated;
+			operation.tiling = (VkImageTiling)tiling;
+		}
+		trace.push_back(operation);
+	}
+
+	return trace;
+}
+
+// Synthetic sequence close to the demo scene's loading, used when no trace is given
+class SceneTraceGenerator {
+public:
+	SceneTraceGenerator(uint32_t seed) : rng(seed) {}
+
+	std::vector<TraceOperation> generate() {
+		// Render targets
+		std::vector<uint64_t> attachments = createAttachments();
+
+		// Materials, up to 5 2K textures each, and the skybox
+		std::vector<uint64_t> textures;
+		for (int i = 0; i < 13 * 5; i++) {
+			textures.push_back(texture(2048, 2048, 1));
+		}
+		textures.push_back(texture(2048, 2048, 6));
+
+		// Models, vertices and indices go through staging buffers
+		std::uniform_int_distribution<uint32_t> vertexCount(100, 50000);
+		for (int i = 0; i < 9; i++) {
+			VkDeviceSize vertices = vertexCount(rng) * 68;
+			VkDeviceSize indices = vertexCount(rng) * 3 * 4;
+			meshBuffer(vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+			meshBuffer(indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		}
+		// Sponza
+		meshBuffer(262267 * 68, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+		meshBuffer(786801 * 4, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+		// Objects, one uniform buffer per frame in flight
+		for (int i = 0; i < 20 * 2; i++) {
+			buffer(256, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		}
+
+		// Window resizes
+		for (int i = 0; i < 3; i++) {
+			for (uint64_t attachment : attachments) {
+				free(attachment);
+			}
+			attachments = createAttachments();
+		}
+
+		// Streaming, textures are unloaded and smaller ones are loaded
+		std::uniform_int_distribution<int> level(7, 11);
+		for (int i = 0; i < 200; i++) {
+			std::uniform_int_distribution<size_t> index(0, textures.size() - 1);
+			size_t unloaded = index(rng);
+			free(textures[unloaded]);
+			uint32_t side = 1 << level(rng);
+			textures[unloaded] = texture(side, side, 1);
+		}
+
+		return trace;
+	}
+
+private:
+	uint64_t push(char type, VkDeviceSize size, VkDeviceSize alignment, uint32_t memoryTypeBits, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, bool dedicated) {
+		TraceOperation operation = { type, nextId++, size, alignment, memoryTypeBits, usage, flags, VK_IMAGE_TILING_OPTIMAL, dedicated };
+		trace.push_back(operation);
+
+		return operation.id;
+	}
+
+	void free(uint64_t id) {
+		TraceOperation operation = {};
+		operation.type = 'f';
+		operation.id = id;
+		trace.push_back(operation);
+	}
+
+	uint64_t buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags) {
+		return push('b', size, 0, 0, usage, flags, false);
+	}
+
+	uint64_t image(VkDeviceSize size, bool dedicated) {
+		return push('i', (size + 65535) / 65536 * 65536, 65536, 0x5, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, dedicated);
+	}
+
+	uint64_t texture(uint32_t width, uint32_t height, uint32_t layers) {
+		VkDeviceSize size = (VkDeviceSize)width * height * 4 * layers;
+		uint64_t staging = buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		uint64_t id = image(size + size / 3, false);
+		free(staging);
+
+		return id;
+	}
+
+	void meshBuffer(VkDeviceSize size, VkBufferUsageFlags usage) {
+		uint64_t staging = buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		buffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		free(staging);
+	}
+
+	// Multisampled color, depth and shadow maps for a 1280x720 window
+	std::vector<uint64_t> createAttachments() {
+		std::vector<uint64_t> attachments;
+		attachments.push_back(image(1280 * 720 * 4 * 8, true));
+		attachments.push_back(image(1280 * 720 * 4 * 8, true));
+		for (int i = 0; i < 3; i++) {
+			attachments.push_back(image(2048 * 2048 * 4, true));
+		}
+
+		return attachments;
+	}
+
+	std::mt19937 rng;
+	std::vector<TraceOperation> trace;
+	uint64_t nextId = 0;
+};
+
+struct ReplayResult {
+	double time;
+	VkDeviceSize peakLiveSize;
+};
+
+// Allocations still alive at the end are left in allocations
+ReplayResult replay(const std::vector<TraceOperation>& trace, MockMemoryBackend& backend, MemoryAllocator& allocator, std::unordered_map<uint64_t, Allocation*>& allocations) {
+	VkDeviceSize liveSize = 0;
+	VkDeviceSize peakLiveSize = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (const TraceOperation& operation : trace) {
+		Allocation* allocation = nullptr;
+		if (operation.type == 'b') {
+			allocation = allocator.allocate(operation.size, operation.usage, operation.flags);
+		}
+		else if (operation.type == 'd') {
+			VkBuffer buffer = backend.createBuffer({ operation.size, operation.alignment, operation.memoryTypeBits });
+			allocation = allocator.allocate(&buffer, operation.flags);
+		}
+		else if (operation.type == 'i') {
+			VkImage image = backend.createImage({ operation.size, operation.alignment, operation.memoryTypeBits });
+			allocation = allocator.allocate(&image, operation.tiling, operation.flags, operation.dedicated);
+		}
+		else if (operation.type == 'f') {
+			auto it = allocations.find(operation.id);
+			if (it != allocations.end()) {
+				liveSize -= it->second->size;
+				allocator.free(it->second);
+				allocations.erase(it);
+			}
+		}
+
+		if (allocation) {
+			allocations[operation.id] = allocation;
+			liveSize += allocation->size;
+			peakLiveSize = std::max(peakLiveSize, liveSize);
+		}
+	}
+	double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	return { time, peakLiveSize };
+}
+
+double toMB(VkDeviceSize size) {
+	return (double)size / 1048576.0;
+}
+
+void printStats(const MemoryStats& stats) {
+	std::cout << "  chunks: " << stats.chunkCount << ", used: " << toMB(stats.total.usedSize) << " MB / " << toMB(stats.total.size) << " MB"
+		<< ", largest free block: " << toMB(stats.total.largestFreeBlock) << " MB"
+		<< ", fragmentation: " << stats.total.fragmentation
+		<< ", alignment waste: " << toMB(stats.total.alignmentWaste) << " MB" << std::endl;
+}
+
+void freeAll(MemoryAllocator& allocator, std::unordered_map<uint64_t, Allocation*>& allocations) {
+	for (auto& allocation : allocations) {
+		allocator.free(allocation.second);
+	}
+	allocations.clear();
+	allocator.free();
+}
+
+void initAllocator(MockMemoryBackend& backend, MemoryAllocator& allocator) {
+	allocator.setBackend(&backend);
+	allocator.setPhysicalDeviceMemoryProperties(backend.getMemoryProperties());
+	allocator.setPhysicalDeviceLimits(backend.getLimits());
+}
+
+void benchmark(const std::string& name, const std::vector<TraceOperation>& trace) {
+	std::cout << name << " (" << trace.size() << " operations)" << std::endl;
+
+	// Throughput, each iteration starts from an empty allocator
+	double totalTime = 0.0;
+	for (int i = 0; i < REPLAY_ITERATIONS; i++) {
+		MockMemoryBackend backend;
+		MemoryAllocator allocator;
+		initAllocator(backend, allocator);
+		std::unordered_map<uint64_t, Allocation*> allocations;
+		totalTime += replay(trace, backend, allocator, allocations).time;
+		freeAll(allocator, allocations);
+	}
+	double averageTime = totalTime / REPLAY_ITERATIONS;
+	std::cout << "  replay: " << averageTime << " ms, " << (trace.size() / averageTime) * 1000.0 << " operations/s" << std::endl;
+
+	// Usage and fragmentation
+	MockMemoryBackend backend;
+	MemoryAllocator allocator;
+	initAllocator(backend, allocator);
+	std::unordered_map<uint64_t, Allocation*> allocations;
+	ReplayResult result = replay(trace, backend, allocator, allocations);
+	std::cout << "  peak device memory: " << toMB(backend.getPeakAllocatedSize()) << " MB, peak live allocations: " << toMB(result.peakLiveSize) << " MB" << std::endl;
+	printStats(allocator.getStats());
+
+	// Defragmentation until nothing more can be moved
+	VkDeviceSize deviceSize = backend.getAllocatedSize();
+	backend.resetPeak();
+	uint32_t passes = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<Allocation*> movedAllocations;
+	while (allocator.needsDefragmentation()) {
+		VkDeviceSize moved = allocator.defragment(VK_NULL_HANDLE, DEFRAGMENTATION_MAX_BYTES, 0, movedAllocations);
+		allocator.finishDefragmentation(0);
+		if (moved == 0) {
+			break;
+		}
+		passes++;
+	}
+	double defragmentationTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "  defragmentation: " << passes << " passes, " << toMB(backend.getCopiedSize()) << " MB copied, " << defragmentationTime << " ms"
+		<< ", device memory " << toMB(deviceSize) << " MB -> " << toMB(backend.getAllocatedSize()) << " MB" << std::endl;
+	printStats(allocator.getStats());
+
+	freeAll(allocator, allocations);
+}
+
+// Threads allocating and freeing small buffers at the same time, like assets loaded in parallel
+void benchmarkThreads() {
+	std::cout << "Parallel small buffers (" << THREAD_ALLOCATIONS << " allocations per thread)" << std::endl;
+	for (uint32_t threadCount : { 1, 2, 4, 8 }) {
+		MockMemoryBackend backend;
+		MemoryAllocator allocator;
+		initAllocator(backend, allocator);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> threads;
+		for (uint32_t i = 0; i < threadCount; i++) {
+			threads.emplace_back([&allocator, i]() {
+				std::mt19937 rng(i);
+				std::uniform_int_distribution<VkDeviceSize> size(16, 4096);
+				std::vector<Allocation*> allocations;
+				for (int j = 0; j < THREAD_ALLOCATIONS; j++) {
+					allocations.push_back(allocator.allocate(size(rng), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+					// Keep some allocations alive, free the others in random order
+					if (allocations.size() == 64) {
+						std::shuffle(allocations.begin(), allocations.end(), rng);
+						for (size_t k = 32; k < allocations.size(); k++) {
+							allocator.free(allocations[k]);
+						}
+						allocations.resize(32);
+					}
+				}
+				for (Allocation* allocation : allocations) {
+					allocator.free(allocation);
+				}
+			});
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		std::cout << "  " << threadCount << " threads: " << time << " ms, " << ((double)threadCount * THREAD_ALLOCATIONS * 2 / time) * 1000.0 << " operations/s" << std::endl;
+		allocator.free();
+	}
+}
+
+// Traces are recorded by the engine built with ONIENGINE_MEMORY_TRACE
+int main(int argc, char* argv[]) {
+	try {
+		if (argc > 1) {
+			for (int i = 1; i < argc; i++) {
+				benchmark(argv[i], loadTrace(argv[i]));
+			}
+		}
+		else {
+			SceneTraceGenerator generator(42);
+			benchmark("Synthetic scene", generator.generate());
+		}
+		benchmarkThreads();
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
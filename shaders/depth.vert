@@ -0,0 +1,35 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+struct ObjectData {
+	mat4 model;
+	mat4 normal;
+	uint materialIndex;
+};
+
+// Every object of the frame
+layout(std430, binding = 0) readonly buffer ObjectBufferObject {
+	ObjectData objects[];
+} obo;
+
+// Object index of each instance, draws start at their group's first instance
+layout(std430, binding = 5) readonly buffer InstanceBufferObject {
+	uint objectIndices[];
+} ibo;
+
+layout(binding = 1) uniform CameraBufferObject {
+	mat4 view;
+	mat4 proj;
+	vec3 pos;
+} cbo;
+
+layout(location = 0) in vec3 inPosition;
+
+// The PBR pass tests its depth for equality with this one, both compute it the same way
+invariant gl_Position;
+
+void main() {
+	ObjectData object = obo.objects[ibo.objectIndices[gl_InstanceIndex]];
+	vec3 fragPos = vec3(object.model * vec4(inPosition, 1.0));
+	gl_Position = cbo.proj * cbo.view * vec4(fragPos, 1.0);
+}
\ No newline at end of file
@@ -20,11 +20,11 @@ layout(binding = 2) uniform Lights {
 } lights;
 
 layout(binding = 4) uniform sampler2D shadowsTexSampler[numShadowmaps];
-layout(binding = 5) uniform sampler2D diffuseTexSampler;
-layout(binding = 6) uniform sampler2D normalTexSampler;
-layout(binding = 7) uniform sampler2D metallicTexSampler;
-layout(binding = 8) uniform sampler2D roughnessTexSampler;
-layout(binding = 9) uniform sampler2D AOTexSampler;
+layout(set = 1, binding = 0) uniform sampler2D diffuseTexSampler;
+layout(set = 1, binding = 1) uniform sampler2D normalTexSampler;
+layout(set = 1, binding = 2) uniform sampler2D metallicTexSampler;
+layout(set = 1, binding = 3) uniform sampler2D roughnessTexSampler;
+layout(set = 1, binding = 4) uniform sampler2D AOTexSampler;
 
 layout(location = 0) in vec3 fragNormal;
 layout(location = 1) in vec2 fragTexCoords;
@@ -5,10 +5,22 @@
 #define MAX_POINT_LIGHTS 10
 #define MAX_SPOT_LIGHTS 10
 
-layout(binding = 0) uniform ObjectBufferObject {
+struct ObjectData {
 	mat4 model;
+	mat4 normal;
+	uint materialIndex;
+};
+
+// Every object of the frame
+layout(std430, binding = 0) readonly buffer ObjectBufferObject {
+	ObjectData objects[];
 } obo;
 
+// Object index of each instance, draws start at their group's first instance
+layout(std430, binding = 5) readonly buffer InstanceBufferObject {
+	uint objectIndices[];
+} ibo;
+
 layout(binding = 1) uniform CameraBufferObject {
 	mat4 view;
 	mat4 proj;
@@ -36,10 +48,13 @@ layout(location = 4) out vec4 fragDirLightsSpace[MAX_DIR_LIGHTS];
 layout(location = MAX_DIR_LIGHTS + 4) out vec4 fragSpotLightsSpace[MAX_SPOT_LIGHTS];
 layout(location = MAX_SPOT_LIGHTS + MAX_DIR_LIGHTS + 4) out mat3 fragTBN;
 
+// Same depth as the depth pre-pass, which the pass can test for equality
+invariant gl_Position;
+
 void main() {
-	mat3 normalMatrix = transpose(inverse(mat3(obo.model)));
-	fragNormal = normalize(normalMatrix * inNormal);
-	fragPos = vec3(obo.model * vec4(inPosition, 1.0));
+	ObjectData object = obo.objects[ibo.objectIndices[gl_InstanceIndex]];
+	fragNormal = normalize(mat3(object.normal) * inNormal);
+	fragPos = vec3(object.model * vec4(inPosition, 1.0));
 	fragTexCoords = inTexCoords;
 	fragCamPos = cbo.pos;
 	for (int i = 0; i < sbo.numLights.x; i++) {
@@ -48,9 +63,9 @@ void main() {
 	for (int i = 0; i < sbo.numLights.z; i++) {
 		fragSpotLightsSpace[i] = sbo.spotLightsSpace[i] * vec4(fragPos, 1.0);
 	}
-	vec3 T = normalize(vec3(obo.model * vec4(inTangent, 0.0)));
-	vec3 B = normalize(vec3(obo.model * vec4(inBitangent, 0.0)));
-	vec3 N = normalize(vec3(obo.model * vec4(inNormal, 0.0)));
+	vec3 T = normalize(vec3(object.model * vec4(inTangent, 0.0)));
+	vec3 B = normalize(vec3(object.model * vec4(inBitangent, 0.0)));
+	vec3 N = normalize(vec3(object.model * vec4(inNormal, 0.0)));
 	fragTBN = mat3(T, B, N);
 	gl_Position = cbo.proj * cbo.view * vec4(fragPos, 1.0);
 }
\ No newline at end of file
@@ -5,10 +5,22 @@
 #define MAX_POINT_LIGHTS 10
 #define MAX_SPOT_LIGHTS 10
 
-layout(binding = 0) uniform ObjectBufferObject {
+struct ObjectData {
 	mat4 model;
+	mat4 normal;
+	uint materialIndex;
+};
+
+// Every object of the frame
+layout(std430, binding = 0) readonly buffer ObjectBufferObject {
+	ObjectData objects[];
 } obo;
 
+// Object index of each instance, draws start at their group's first instance
+layout(std430, binding = 2) readonly buffer InstanceBufferObject {
+	uint objectIndices[];
+} ibo;
+
 layout(binding = 1) uniform ShadowsBufferObject {
 	vec3 numLights;
 	mat4 dirLightsSpace[MAX_DIR_LIGHTS];
@@ -22,11 +34,12 @@ layout(push_constant) uniform LightIndex {
 layout(location = 0) in vec3 inPosition;
 
 void main() {
+	mat4 model = obo.objects[ibo.objectIndices[gl_InstanceIndex]].model;
 	int numDirLights = int(sbo.numLights.x);
 	if (li.lightIndex < numDirLights) {
-		gl_Position = sbo.dirLightsSpace[li.lightIndex] * obo.model * vec4(inPosition, 1.0);
+		gl_Position = sbo.dirLightsSpace[li.lightIndex] * model * vec4(inPosition, 1.0);
 	} else if (li.lightIndex >= numDirLights) {
-		gl_Position = sbo.spotLightsSpace[li.lightIndex - numDirLights] * obo.model * vec4(inPosition, 1.0);
+		gl_Position = sbo.spotLightsSpace[li.lightIndex - numDirLights] * model * vec4(inPosition, 1.0);
 	}
 	gl_Position.z = (gl_Position.z + gl_Position.w) / 2.0;
 }
\ No newline at end of file
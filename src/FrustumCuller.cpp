@@ -0,0 +1,95 @@
+#include "FrustumCuller.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+void FrustumCuller::resize(size_t newCount) {
+	count = newCount;
+	size_t paddedCount = (count + FRUSTUM_CULLER_WIDTH - 1) / FRUSTUM_CULLER_WIDTH * FRUSTUM_CULLER_WIDTH;
+	// Padding spheres are never written so they stay empty
+	centersX.assign(paddedCount, 0.0f);
+	centersY.assign(paddedCount, 0.0f);
+	centersZ.assign(paddedCount, 0.0f);
+	radii.assign(paddedCount, 0.0f);
+}
+
+size_t FrustumCuller::size() {
+	return count;
+}
+
+void FrustumCuller::setSphere(size_t index, float x, float y, float z, float radius) {
+	centersX[index] = x;
+	centersY[index] = y;
+	centersZ[index] = z;
+	radii[index] = radius;
+}
+
+size_t FrustumCuller::cull(const float* planes, uint8_t* visible) {
+	size_t visibleCount = 0;
+#if defined(__AVX__)
+	for (size_t i = 0; i < count; i += 8) {
+		__m256 x = _mm256_loadu_ps(&centersX[i]);
+		__m256 y = _mm256_loadu_ps(&centersY[i]);
+		__m256 z = _mm256_loadu_ps(&centersZ[i]);
+		__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radii[i]));
+		// Lanes stay set while the spheres are in front of every plane
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			const float* plane = &planes[p * 4];
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane[0])), _mm256_mul_ps(y, _mm256_set1_ps(plane[1]))),
+				_mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane[2])), _mm256_set1_ps(plane[3])));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+		int mask = _mm256_movemask_ps(inside);
+		size_t laneCount = count - i < 8 ? count - i : 8;
+		for (size_t lane = 0; lane < laneCount; lane++) {
+			visible[i + lane] = (mask >> lane) & 1;
+			visibleCount += visible[i + lane];
+		}
+	}
+#elif defined(FRUSTUM_CULLER_SSE)
+	for (size_t i = 0; i < count; i += 4) {
+		__m128 x = _mm_loadu_ps(&centersX[i]);
+		__m128 y = _mm_loadu_ps(&centersY[i]);
+		__m128 z = _mm_loadu_ps(&centersZ[i]);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radii[i]));
+		// Lanes stay set while the spheres are in front of every plane
+		__m128 inside = _mm_cmpeq_ps(x, x);
+		for (int p = 0; p < 6; p++) {
+			const float* plane = &planes[p * 4];
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane[0])), _mm_mul_ps(y, _mm_set1_ps(plane[1]))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane[2])), _mm_set1_ps(plane[3])));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+		int mask = _mm_movemask_ps(inside);
+		size_t laneCount = count - i < 4 ? count - i : 4;
+		for (size_t lane = 0; lane < laneCount; lane++) {
+			visible[i + lane] = (mask >> lane) & 1;
+			visibleCount += visible[i + lane];
+		}
+	}
+#else
+	visibleCount = cullScalar(planes, visible);
+#endif
+
+	return visibleCount;
+}
+
+size_t FrustumCuller::cullScalar(const float* planes, uint8_t* visible) {
+	size_t visibleCount = 0;
+	for (size_t i = 0; i < count; i++) {
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++) {
+			const float* plane = &planes[p * 4];
+			inside = (centersX[i] * plane[0] + centersY[i] * plane[1]) + (centersZ[i] * plane[2] + plane[3]) >= -radii[i];
+		}
+		visible[i] = inside ? 1 : 0;
+		visibleCount += visible[i];
+	}
+
+	return visibleCount;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Spheres tested per SIMD instruction, 8 with AVX, 4 with SSE
+#if defined(__AVX__)
+#define FRUSTUM_CULLER_WIDTH 8
+#else
+#define FRUSTUM_CULLER_WIDTH 4
+#endif
+
+// World bounding spheres stored as structure of arrays, tested against the six planes of a frustum several at a time
+// Planes are (a, b, c, d) with normals pointing inside the frustum, a sphere is visible when it is not fully behind a plane
+class FrustumCuller {
+public:
+	void resize(size_t newCount);
+	size_t size();
+	void setSphere(size_t index, float x, float y, float z, float radius);
+	// Sets visible[i] to 1 for the visible spheres and to 0 for the others, returns the number of visible spheres
+	size_t cull(const float* planes, uint8_t* visible);
+	// One sphere at a time, reference for the benchmarks
+	size_t cullScalar(const float* planes, uint8_t* visible);
+private:
+	size_t count = 0;
+	// Padded to a multiple of FRUSTUM_CULLER_WIDTH
+	std::vector<float> centersX;
+	std::vector<float> centersY;
+	std::vector<float> centersZ;
+	std::vector<float> radii;
+};
@@ -1,4 +1,5 @@
 #include "Material.h"
+#include "MemoryAllocator.h"
 
 Material::Material(std::string dPath, std::string nPath, std::string mPath, std::string rPath, std::string aPath) {
 	diffusePath = dPath;
@@ -22,6 +23,7 @@ Material::Material(std::string dPath, std::string nPath, std::string mPath, std:
 
 	AOValue = 1.0f;
 
+	index = 0;
 	constructed = false;
 	destructed = false;
 }
@@ -198,6 +200,14 @@ void Material::setDiffuseTextureSampler(VkSampler newDiffuseTextureSampler) {
 	diffuseTextureSampler = newDiffuseTextureSampler;
 }
 
+Allocation** Material::getDiffuseTextureAllocation() {
+	return &diffuseTextureAllocation;
+}
+
+void Material::setDiffuseTextureAllocation(Allocation* newDiffuseTextureAllocation) {
+	diffuseTextureAllocation = newDiffuseTextureAllocation;
+}
+
 // Normal
 
 VkImage* Material::getNormalTextureImage() {
@@ -224,6 +234,14 @@ void Material::setNormalTextureSampler(VkSampler newNormalTextureSampler) {
 	normalTextureSampler = newNormalTextureSampler;
 }
 
+Allocation** Material::getNormalTextureAllocation() {
+	return &normalTextureAllocation;
+}
+
+void Material::setNormalTextureAllocation(Allocation* newNormalTextureAllocation) {
+	normalTextureAllocation = newNormalTextureAllocation;
+}
+
 // Metallic
 
 VkImage* Material::getMetallicTextureImage() {
@@ -250,6 +268,14 @@ void Material::setMetallicTextureSampler(VkSampler newMetallicTextureSampler) {
 	metallicTextureSampler = newMetallicTextureSampler;
 }
 
+Allocation** Material::getMetallicTextureAllocation() {
+	return &metallicTextureAllocation;
+}
+
+void Material::setMetallicTextureAllocation(Allocation* newMetallicTextureAllocation) {
+	metallicTextureAllocation = newMetallicTextureAllocation;
+}
+
 // Roughness
 
 VkImage* Material::getRoughnessTextureImage() {
@@ -276,6 +302,14 @@ void Material::setRoughnessTextureSampler(VkSampler newRoughnessTextureSampler)
 	roughnessTextureSampler = newRoughnessTextureSampler;
 }
 
+Allocation** Material::getRoughnessTextureAllocation() {
+	return &roughnessTextureAllocation;
+}
+
+void Material::setRoughnessTextureAllocation(Allocation* newRoughnessTextureAllocation) {
+	roughnessTextureAllocation = newRoughnessTextureAllocation;
+}
+
 // AO
 
 VkImage* Material::getAOTextureImage() {
@@ -302,6 +336,32 @@ void Material::setAOTextureSampler(VkSampler newAOTextureSampler) {
 	AOTextureSampler = newAOTextureSampler;
 }
 
+Allocation** Material::getAOTextureAllocation() {
+	return &AOTextureAllocation;
+}
+
+void Material::setAOTextureAllocation(Allocation* newAOTextureAllocation) {
+	AOTextureAllocation = newAOTextureAllocation;
+}
+
+// Descriptor set
+
+std::vector<VkDescriptorSet>* Material::getDescriptorSets() {
+	return &descriptorSets;
+}
+
+VkDescriptorSet* Material::getDescriptorSet(uint32_t frame) {
+	return &descriptorSets[frame];
+}
+
+uint32_t Material::getIndex() {
+	return index;
+}
+
+void Material::setIndex(uint32_t newIndex) {
+	index = newIndex;
+}
+
 // Constructed
 
 bool Material::isConstructed() {
@@ -1,6 +1,9 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
 #include <string>
+#include <vector>
+
+struct Allocation;
 
 class Material {
 public:
@@ -53,6 +56,8 @@ public:
 	void setDiffuseTextureImageView(VkImageView newDiffuseTextureImageView);
 	VkSampler* getDiffuseTextureSampler();
 	void setDiffuseTextureSampler(VkSampler newDiffuseTextureSampler);
+	Allocation** getDiffuseTextureAllocation();
+	void setDiffuseTextureAllocation(Allocation* newDiffuseTextureAllocation);
 
 	VkImage* getNormalTextureImage();
 	void setNormalTextureImage(VkImage newNormalTextureImage);
@@ -60,6 +65,8 @@ public:
 	void setNormalTextureImageView(VkImageView newNormalTextureImageView);
 	VkSampler* getNormalTextureSampler();
 	void setNormalTextureSampler(VkSampler newNormalTextureSampler);
+	Allocation** getNormalTextureAllocation();
+	void setNormalTextureAllocation(Allocation* newNormalTextureAllocation);
 
 	VkImage* getMetallicTextureImage();
 	void setMetallicTextureImage(VkImage newMetallicTextureImage);
@@ -67,6 +74,8 @@ public:
 	void setMetallicTextureImageView(VkImageView newMetallicTextureImageView);
 	VkSampler* getMetallicTextureSampler();
 	void setMetallicTextureSampler(VkSampler newMetallicTextureSampler);
+	Allocation** getMetallicTextureAllocation();
+	void setMetallicTextureAllocation(Allocation* newMetallicTextureAllocation);
 
 	VkImage* getRoughnessTextureImage();
 	void setRoughnessTextureImage(VkImage newRoughnessTextureImage);
@@ -74,6 +83,8 @@ public:
 	void setRoughnessTextureImageView(VkImageView newRoughnessTextureImageView);
 	VkSampler* getRoughnessTextureSampler();
 	void setRoughnessTextureSampler(VkSampler newRoughnessTextureSampler);
+	Allocation** getRoughnessTextureAllocation();
+	void setRoughnessTextureAllocation(Allocation* newRoughnessTextureAllocation);
 
 	VkImage* getAOTextureImage();
 	void setAOTextureImage(VkImage newAOTextureImage);
@@ -81,6 +92,13 @@ public:
 	void setAOTextureImageView(VkImageView newAOTextureImageView);
 	VkSampler* getAOTextureSampler();
 	void setAOTextureSampler(VkSampler newAOTextureSampler);
+	Allocation** getAOTextureAllocation();
+	void setAOTextureAllocation(Allocation* newAOTextureAllocation);
+
+	std::vector<VkDescriptorSet>* getDescriptorSets();
+	VkDescriptorSet* getDescriptorSet(uint32_t frame);
+	uint32_t getIndex();
+	void setIndex(uint32_t newIndex);
 
 	bool isConstructed();
 	void constructedTrue();
@@ -96,6 +114,7 @@ private:
 	VkImage diffuseTextureImage;
 	VkImageView diffuseTextureImageView;
 	VkSampler diffuseTextureSampler;
+	Allocation* diffuseTextureAllocation;
 	uint32_t diffuseMipLevel;
 
 	std::string normalPath;
@@ -106,6 +125,7 @@ private:
 	VkImage normalTextureImage;
 	VkImageView normalTextureImageView;
 	VkSampler normalTextureSampler;
+	Allocation* normalTextureAllocation;
 	uint32_t normalMipLevel;
 
 	std::string metallicPath;
@@ -114,6 +134,7 @@ private:
 	VkImage metallicTextureImage;
 	VkImageView metallicTextureImageView;
 	VkSampler metallicTextureSampler;
+	Allocation* metallicTextureAllocation;
 	uint32_t metallicMipLevel;
 
 	std::string roughnessPath;
@@ -122,6 +143,7 @@ private:
 	VkImage roughnessTextureImage;
 	VkImageView roughnessTextureImageView;
 	VkSampler roughnessTextureSampler;
+	Allocation* roughnessTextureAllocation;
 	uint32_t roughnessMipLevel;
 
 	std::string AOPath;
@@ -130,8 +152,14 @@ private:
 	VkImage AOTextureImage;
 	VkImageView AOTextureImageView;
 	VkSampler AOTextureSampler;
+	Allocation* AOTextureAllocation;
 	uint32_t AOMipLevel;
 
+	// Textures of the material for each frame in flight, shared by the objects using it
+	std::vector<VkDescriptorSet> descriptorSets;
+	// Place of the material in the renderer's materials
+	uint32_t index;
+
 	bool constructed;
 	bool destructed;
 };
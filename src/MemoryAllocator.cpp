@@ -1,166 +1,1112 @@
 #include "MemoryAllocator.h"
 
-Chunk::Chunk(VkDevice* device, int32_t memoryType, VkDeviceSize size) {
-    type = memoryType;
+static VkDeviceMemory allocateChunkMemory(MemoryBackend* backend, int32_t memoryType, VkDeviceSize size, const void* pNext) {
+    VkDeviceMemory memory;
 
     VkMemoryAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = pNext;
     allocInfo.allocationSize = size;
     allocInfo.memoryTypeIndex = memoryType;
-    if (vkAllocateMemory(*device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+    if (backend->allocateMemory(&allocInfo, &memory) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate memory (chunk creation)!");
     }
 
-    Block* block = new Block();
-    block->offset = 0;
-    block->size = size;
-    block->inUse = false;
-    block->next = nullptr;
+    return memory;
+}
+
+Chunk::Chunk(MemoryBackend* backend, int32_t memoryType, VkDeviceSize size, bool linearResources, const VkMemoryDedicatedAllocateInfo* dedicatedInfo) {
+    type = memoryType;
+    memory = allocateChunkMemory(backend, memoryType, size, dedicatedInfo);
+    this->size = size;
+    allocator = new TLSF(size);
+    data = nullptr;
 
-    head = block;
+    buffer = VK_NULL_HANDLE;
+    usage = 0;
+    flags = 0;
+    linear = linearResources;
+    dedicated = dedicatedInfo != nullptr;
+    defragmentationFailedGeneration = 0;
 }
 
-VkDeviceSize Chunk::allocate(VkMemoryRequirements memRequirements) {
-    Block* curr = head;
-    while (curr) {
-        if (!curr->inUse) {
-            VkDeviceSize actualSize = curr->size;
+Chunk::Chunk(MemoryBackend* backend, int32_t memoryType, VkDeviceSize size, VkBuffer chunkBuffer, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferFlags) {
+    type = memoryType;
+    memory = allocateChunkMemory(backend, memoryType, size, nullptr);
+    this->size = size;
+    // Sub-allocations must stay inside the buffer
+    allocator = new TLSF(bufferSize);
+    data = nullptr;
 
-            // Size of the block minus the alignment (wasted bytes)
-            if (curr->offset % memRequirements.alignment != 0) {
-                actualSize -= memRequirements.alignment - curr->offset % memRequirements.alignment;
-            }
+    buffer = chunkBuffer;
+    usage = bufferUsage;
+    flags = bufferFlags;
+    linear = true;
+    dedicated = false;
+    defragmentationFailedGeneration = 0;
+    backend->bindBufferMemory(buffer, memory, 0);
+}
 
-            // If we have enough space to allocate here
-            if (actualSize >= memRequirements.size) {
-                // Set the size of the block to be the size with alignment
-                curr->size = actualSize;
+Block* Chunk::allocate(VkMemoryRequirements memRequirements) {
+    return allocator->allocate(memRequirements.size, memRequirements.alignment);
+}
 
-                // Align offset
-                if (curr->offset % memRequirements.alignment != 0) {
-                    curr->offset += memRequirements.alignment - curr->offset % memRequirements.alignment;
-                }
+void Chunk::freeBlocks() {
+    delete allocator;
+    allocator = nullptr;
+}
 
-                // If we have exactly enough space, no need to subdivide
-                if (curr->size == memRequirements.size) {
-                    curr->inUse = true;
-                    return curr->offset;
+// Ids of the allocators, so that threads know which allocator their cached ThreadCache belongs to
+static std::atomic<uint64_t> nextAllocatorId{ 1 };
+
+MemoryAllocator::MemoryAllocator() {
+    allocatorId = nextAllocatorId++;
+}
+
+void MemoryAllocator::setBackend(MemoryBackend* newBackend) {
+    backend = newBackend;
+}
+
+void MemoryAllocator::setPhysicalDeviceMemoryProperties(VkPhysicalDeviceMemoryProperties newPhysicalDeviceMemoryProperties) {
+    memoryProperties = newPhysicalDeviceMemoryProperties;
+    updateBudget();
+}
+
+void MemoryAllocator::setPhysicalDeviceLimits(VkPhysicalDeviceLimits newPhysicalDeviceLimits) {
+    limits = newPhysicalDeviceLimits;
+}
+
+void MemoryAllocator::setHeapBudget(uint32_t heap, VkDeviceSize budget) {
+    {
+        std::lock_guard<std::mutex> lock(budgetMutex);
+        heapBudgets[heap].userBudget = budget;
+    }
+    updateBudget();
+}
+
+void MemoryAllocator::setEvictionCallback(EvictionCallback callback, void* userData) {
+    evictionCallback = callback;
+    evictionUserData = userData;
+}
+
+void MemoryAllocator::updateBudget() {
+    std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> budgets;
+    std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> usages;
+    bool deviceBudget = backend && backend->getMemoryBudget(budgets.data(), usages.data());
+
+    std::lock_guard<std::mutex> lock(budgetMutex);
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+        HeapBudget& heapBudget = heapBudgets[i];
+        if (deviceBudget) {
+            heapBudget.budget = budgets[i];
+            heapBudget.processUsage = usages[i];
+        }
+        else {
+            heapBudget.budget = (VkDeviceSize)(memoryProperties.memoryHeaps[i].size * HEAP_BUDGET_RATIO);
+            heapBudget.processUsage = heapBudget.usage;
+        }
+        heapBudget.queriedUsage = heapBudget.usage;
+
+        if (heapBudget.userBudget != 0) {
+            heapBudget.budget = std::min(heapBudget.budget, heapBudget.userBudget);
+        }
+    }
+}
+
+Allocation* MemoryAllocator::allocate(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags) {
+    VkMemoryRequirements memRequirements;
+    memRequirements.size = getBufferBlockSize(size);
+    memRequirements.alignment = getBufferAlignment(usage);
+    memRequirements.memoryTypeBits = 0;
+
+    Allocation* allocation = allocateFromThreadCache(size, usage, flags);
+    if (!allocation) {
+        allocation = new Allocation();
+        allocation->size = size;
+
+        // Look for the first buffer chunk with the same usage and enough space
+        bool allocated = false;
+        {
+            std::shared_lock<std::shared_mutex> lock(chunksMutex);
+            for (Chunk* chunk : chunks) {
+                if (chunk->buffer != VK_NULL_HANDLE && chunk->usage == usage && chunk->flags == flags) {
+                    if (allocateInChunk(chunk, memRequirements, allocation)) {
+                        allocated = true;
+                        break;
+                    }
                 }
+            }
+        }
 
-                // Subdivide the block by creating a new one
-                Block* newBlock = new Block();
-                newBlock->inUse = false;
-                newBlock->offset = curr->offset + memRequirements.size;
-                newBlock->size = curr->size - memRequirements.size;
-                newBlock->next = curr->next;
+        // No block has been found, create a new buffer chunk
+        if (!allocated) {
+            Chunk* newChunk = createBufferChunk(std::max((VkDeviceSize)BUFFER_CHUNK_SIZE, size), usage, flags);
 
-                // The size of the current block is now the size of the data
-                curr->size = memRequirements.size;
-                curr->inUse = true;
-                curr->next = newBlock;
+            std::unique_lock<std::shared_mutex> lock(chunksMutex);
+            addChunk(newChunk);
+            if (!allocateInChunk(newChunk, memRequirements, allocation)) {
+                delete allocation;
+                throw std::runtime_error("Failed to allocate memory (buffer block allocation)!");
+            }
+        }
+    }
+
+    if (traceFile) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        *traceFile << "b " << allocation->id << " " << size << " " << usage << " " << flags << "\n";
+    }
+
+    return allocation;
+}
+
+Allocation* MemoryAllocator::allocate(VkBuffer* bufferToAllocate, VkMemoryPropertyFlags flags) {
+    VkMemoryRequirements memRequirements;
+    backend->getBufferMemoryRequirements(*bufferToAllocate, &memRequirements);
+
+    Allocation* allocation;
+    if (memRequirements.size >= DEDICATED_ALLOCATION_SIZE || backend->prefersDedicatedBuffer(*bufferToAllocate)) {
+        allocation = allocateDedicated(memRequirements, flags, true, *bufferToAllocate, VK_NULL_HANDLE);
+    }
+    else {
+        allocation = allocate(memRequirements, flags, true);
+    }
+    allocation->buffer = *bufferToAllocate;
+    backend->bindBufferMemory(*bufferToAllocate, allocation->chunk->memory, allocation->offset);
+
+    if (traceFile) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        *traceFile << "d " << allocation->id << " " << memRequirements.size << " " << memRequirements.alignment << " " << memRequirements.memoryTypeBits << " " << flags << "\n";
+    }
+
+    return allocation;
+}
+
+Allocation* MemoryAllocator::allocate(VkImage* imageToAllocate, VkImageTiling tiling, VkMemoryPropertyFlags flags, bool dedicated) {
+    VkMemoryRequirements memRequirements;
+    backend->getImageMemoryRequirements(*imageToAllocate, &memRequirements);
+
+    Allocation* allocation;
+    bool linear = tiling == VK_IMAGE_TILING_LINEAR;
+    if (dedicated || memRequirements.size >= DEDICATED_ALLOCATION_SIZE || backend->prefersDedicatedImage(*imageToAllocate)) {
+        allocation = allocateDedicated(memRequirements, flags, linear, VK_NULL_HANDLE, *imageToAllocate);
+    }
+    else {
+        allocation = allocate(memRequirements, flags, linear);
+    }
+    allocation->image = *imageToAllocate;
+    backend->bindImageMemory(*imageToAllocate, allocation->chunk->memory, allocation->offset);
 
-                return curr->offset;
+    if (traceFile) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        *traceFile << "i " << allocation->id << " " << memRequirements.size << " " << memRequirements.alignment << " " << memRequirements.memoryTypeBits << " " << flags << " " << tiling << " " << dedicated << "\n";
+    }
+
+    return allocation;
+}
+
+Allocation* MemoryAllocator::allocate(VkMemoryRequirements memRequirements, VkMemoryPropertyFlags flags, bool linear) {
+    // Chunks redirected to system memory are used while the device local heap has no space left for a new chunk
+    VkDeviceSize chunkSize = std::max((VkDeviceSize)CHUNK_SIZE, memRequirements.size);
+    VkMemoryPropertyFlags chunkFlags = flags;
+    if (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+        uint32_t heap = memoryProperties.memoryTypes[findProperties(memRequirements.memoryTypeBits, flags)].heapIndex;
+        if (!isInBudget(heap, chunkSize)) {
+            chunkFlags = flags & ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        }
+    }
+
+    Allocation* allocation = new Allocation();
+    allocation->size = memRequirements.size;
+
+    // Look for the first chunk with enough space
+    {
+        std::shared_lock<std::shared_mutex> lock(chunksMutex);
+        for (Chunk* chunk : chunks) {
+            if (chunk->buffer == VK_NULL_HANDLE && !chunk->dedicated && chunk->linear == linear && isCompatibleMemoryType(chunk->type, memRequirements.memoryTypeBits, chunkFlags)) {
+                if (allocateInChunk(chunk, memRequirements, allocation)) {
+                    return allocation;
+                }
             }
         }
-        curr = curr->next;
     }
 
-    return -1;
+    // No block has been found, create a new chunk, the memory is allocated without holding the lock
+    Chunk* newChunk = new Chunk(backend, findChunkMemoryType(memRequirements.memoryTypeBits, flags, chunkSize), chunkSize, linear, nullptr);
+
+    std::unique_lock<std::shared_mutex> lock(chunksMutex);
+    addChunk(newChunk);
+
+    // Add to this chunk
+    if (!allocateInChunk(newChunk, memRequirements, allocation)) {
+        delete allocation;
+        throw std::runtime_error("Failed to allocate memory (block allocation)!");
+    }
+
+    return allocation;
 }
 
-void Chunk::freeBlocks() {
-    Block* curr;
-    while (head) {
-        curr = head;
-        head = head->next;
-        delete curr;
+Allocation* MemoryAllocator::allocateDedicated(VkMemoryRequirements memRequirements, VkMemoryPropertyFlags flags, bool linear, VkBuffer buffer, VkImage image) {
+    int32_t properties = findChunkMemoryType(memRequirements.memoryTypeBits, flags, memRequirements.size);
+
+    VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.buffer = buffer;
+    dedicatedInfo.image = image;
+
+    Chunk* newChunk = new Chunk(backend, properties, memRequirements.size, linear, &dedicatedInfo);
+
+    std::unique_lock<std::shared_mutex> lock(chunksMutex);
+    addChunk(newChunk);
+
+    Allocation* allocation = new Allocation();
+    allocation->size = memRequirements.size;
+    if (!allocateInChunk(newChunk, memRequirements, allocation)) {
+        delete allocation;
+        throw std::runtime_error("Failed to allocate memory (dedicated allocation)!");
     }
+
+    return allocation;
 }
 
-void MemoryAllocator::setDevice(VkDevice* newDevice) {
-    device = newDevice;
+bool MemoryAllocator::allocateInChunk(Chunk* chunk, VkMemoryRequirements memRequirements, Allocation* allocation) {
+    std::lock_guard<std::mutex> lock(chunk->mutex);
+    Block* block = chunk->allocate(memRequirements);
+    if (!block) {
+        return false;
+    }
+
+    block->userData = allocation;
+    allocation->id = nextAllocationId++;
+    allocation->chunk = chunk;
+    allocation->block = block;
+    allocation->buffer = chunk->buffer;
+    allocation->movable = chunk->buffer != VK_NULL_HANDLE;
+    // The data starts after the alignment padding
+    allocation->offset = block->offset + block->padding;
+
+    return true;
 }
 
-void MemoryAllocator::setPhysicalDeviceMemoryProperties(VkPhysicalDeviceMemoryProperties newPhysicalDeviceMemoryProperties) {
-    memoryProperties = newPhysicalDeviceMemoryProperties;
+Chunk* MemoryAllocator::createBufferChunk(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags) {
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer buffer;
+    if (backend->createBuffer(&bufferInfo, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create chunk buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    backend->getBufferMemoryRequirements(buffer, &memRequirements);
+    int32_t properties = findChunkMemoryType(memRequirements.memoryTypeBits, flags, memRequirements.size);
+
+    // Added to the chunks by the caller
+    return new Chunk(backend, properties, memRequirements.size, buffer, size, usage, flags);
+}
+
+VkDeviceSize MemoryAllocator::getBufferAlignment(VkBufferUsageFlags usage) {
+    // Offsets of sub-allocations must respect the alignment of every usage of the buffer
+    VkDeviceSize alignment = 16;
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+        alignment = std::max(alignment, limits.minUniformBufferOffsetAlignment);
+    }
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+        alignment = std::max(alignment, limits.minStorageBufferOffsetAlignment);
+    }
+    if (usage & (VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT)) {
+        alignment = std::max(alignment, limits.minTexelBufferOffsetAlignment);
+    }
+
+    return alignment;
+}
+
+VkDeviceSize MemoryAllocator::getBufferBlockSize(VkDeviceSize size) {
+    if (size > THREAD_CACHE_MAX_SIZE) {
+        return size;
+    }
+
+    // Small sizes are rounded up to their size class so a cached block fits any allocation of its class
+    VkDeviceSize sizeClass = 16;
+    while (sizeClass < size) {
+        sizeClass <<= 1;
+    }
+
+    return sizeClass;
+}
+
+void MemoryAllocator::free(Allocation* allocation) {
+    if (!allocation) {
+        return;
+    }
+
+    if (traceFile) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        *traceFile << "f " << allocation->id << "\n";
+    }
+
+    if (freeToThreadCache(allocation)) {
+        return;
+    }
+
+    Chunk* chunk;
+    bool empty;
+    {
+        // The defragmentation may have moved the allocation to another chunk until the lock is taken
+        std::shared_lock<std::shared_mutex> lock(chunksMutex);
+        chunk = allocation->chunk;
+        {
+            std::lock_guard<std::mutex> chunkLock(chunk->mutex);
+            chunk->allocator->free(allocation->block);
+            empty = chunk->allocator->isEmpty();
+        }
+
+        // Space has been made, the defragmentation may succeed now
+        freeGeneration++;
+    }
+    delete allocation;
+
+    if (empty) {
+        // Another thread may have used or released the chunk in the meantime
+        std::unique_lock<std::shared_mutex> lock(chunksMutex);
+        if (std::find(chunks.begin(), chunks.end(), chunk) != chunks.end() && chunk->allocator->isEmpty()) {
+            releaseEmptyChunk(chunk);
+        }
+    }
+}
+
+void MemoryAllocator::releaseEmptyChunk(Chunk* chunk) {
+    // Dedicated and big chunks made for a single resource are always released
+    if (chunk->dedicated || chunk->allocator->getSize() != (chunk->buffer != VK_NULL_HANDLE ? BUFFER_CHUNK_SIZE : CHUNK_SIZE)) {
+        destroyChunk(chunk);
+        return;
+    }
+
+    // Keep a small reserve of empty chunks
+    int emptyChunks = 0;
+    for (Chunk* otherChunk : chunks) {
+        if (otherChunk != chunk && otherChunk->type == chunk->type && otherChunk->usage == chunk->usage && otherChunk->flags == chunk->flags && otherChunk->linear == chunk->linear && !otherChunk->dedicated && otherChunk->allocator->isEmpty()) {
+            emptyChunks++;
+        }
+    }
+    if (emptyChunks >= MAX_EMPTY_CHUNKS) {
+        destroyChunk(chunk);
+    }
+}
+
+void MemoryAllocator::free() {
+    std::unique_lock<std::shared_mutex> lock(chunksMutex);
+    flushThreadCaches();
+    {
+        std::lock_guard<std::mutex> cachesLock(threadCachesMutex);
+        for (auto& threadCache : threadCaches) {
+            delete threadCache.second;
+        }
+        threadCaches.clear();
+        allocatorId = nextAllocatorId++;
+    }
+
+    // The device is idle, the previous images of the moves not finished yet can be destroyed
+    for (DefragmentationMove& move : defragmentationMoves) {
+        if (move.image != VK_NULL_HANDLE) {
+            backend->destroyImage(move.image);
+        }
+    }
+    defragmentationMoves.clear();
+
+    while (!chunks.empty()) {
+        destroyChunk(chunks.back());
+    }
+
+    if (traceFile) {
+        traceFile->close();
+        delete traceFile;
+        traceFile = nullptr;
+    }
+
+    if (ringBuffer) {
+        {
+            std::lock_guard<std::mutex> budgetLock(budgetMutex);
+            heapBudgets[memoryProperties.memoryTypes[ringBuffer->memoryType].heapIndex].usage -= ringBuffer->memorySize;
+        }
+        backend->unmapMemory(ringBuffer->memory);
+        backend->destroyBuffer(ringBuffer->buffer);
+        backend->freeMemory(ringBuffer->memory);
+        delete ringBuffer;
+        ringBuffer = nullptr;
+    }
 }
 
-VkDeviceSize MemoryAllocator::allocate(VkBuffer* bufferToAllocate, VkMemoryPropertyFlags flags) {
+void MemoryAllocator::createRingBuffer(VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usage, VkDeviceSize alignment) {
+    ringBuffer = new RingBuffer();
+    ringBuffer->alignment = std::max(alignment, (VkDeviceSize)1);
+    // Each region starts aligned
+    ringBuffer->frameSize = (frameSize + ringBuffer->alignment - 1) & ~(ringBuffer->alignment - 1);
+    ringBuffer->frameOffset = 0;
+    ringBuffer->offset = 0;
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = ringBuffer->frameSize * frameCount;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (backend->createBuffer(&bufferInfo, &ringBuffer->buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create ring buffer!");
+    }
+
     VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(*device, *bufferToAllocate, &memRequirements);
-    int32_t properties = findProperties(memRequirements.memoryTypeBits, flags);
-
-    // Look for the first block with enough space
-    for (Chunk chunk : chunks) {
-        if (chunk.type == properties) {
-            VkDeviceSize offset;
-            offset = chunk.allocate(memRequirements);
-
-            if (offset != -1) {
-                vkBindBufferMemory(*device, *bufferToAllocate, chunk.memory, offset);
-                return 1;
+    backend->getBufferMemoryRequirements(ringBuffer->buffer, &memRequirements);
+
+    // The ring buffer has its own memory as it stays mapped for the whole execution
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findChunkMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memRequirements.size);
+    if (backend->allocateMemory(&allocInfo, &ringBuffer->memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate memory (ring buffer creation)!");
+    }
+    ringBuffer->memoryType = allocInfo.memoryTypeIndex;
+    ringBuffer->memorySize = memRequirements.size;
+    {
+        std::lock_guard<std::mutex> lock(budgetMutex);
+        heapBudgets[memoryProperties.memoryTypes[ringBuffer->memoryType].heapIndex].usage += ringBuffer->memorySize;
+    }
+    backend->bindBufferMemory(ringBuffer->buffer, ringBuffer->memory, 0);
+
+    backend->mapMemory(ringBuffer->memory, &ringBuffer->data);
+}
+
+void MemoryAllocator::beginFrame(uint32_t frame) {
+    updateBudget();
+
+    // The GPU is done with this frame's region, everything in it can be overwritten
+    ringBuffer->frameOffset = ringBuffer->frameSize * frame;
+    ringBuffer->offset = 0;
+}
+
+VkDeviceSize MemoryAllocator::ringAllocate(VkDeviceSize size, void** data) {
+    VkDeviceSize alignedSize = (size + ringBuffer->alignment - 1) & ~(ringBuffer->alignment - 1);
+    if (ringBuffer->offset + alignedSize > ringBuffer->frameSize) {
+        throw std::runtime_error("Failed to allocate memory (ring buffer frame is full)!");
+    }
+
+    VkDeviceSize offset = ringBuffer->frameOffset + ringBuffer->offset;
+    ringBuffer->offset += alignedSize;
+
+    *data = (char*)ringBuffer->data + offset;
+    return offset;
+}
+
+void* MemoryAllocator::mappedPtr(Allocation* allocation) {
+    if (!allocation->chunk->data) {
+        throw std::runtime_error("Failed to get mapped pointer (memory is not host visible)!");
+    }
+
+    // Buffer chunks are bound at the beginning of their memory so buffer offsets are memory offsets
+    return (char*)allocation->chunk->data + allocation->offset;
+}
+
+void MemoryAllocator::setMovable(Allocation* allocation, VkImageCreateInfo imageInfo, VkImageLayout imageLayout) {
+    // The image is recreated with the same info when moved and copied with transfer commands
+    allocation->imageInfo = imageInfo;
+    allocation->imageInfo.pNext = nullptr;
+    allocation->imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    allocation->imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    allocation->imageLayout = imageLayout;
+    // Dedicated memory belongs to the image, it is never moved
+    allocation->movable = !allocation->chunk->dedicated && (imageInfo.usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) && (imageInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+}
+
+static bool isSparse(TLSF* allocator) {
+    return !allocator->isEmpty() && allocator->getUsedSize() * DEFRAGMENTATION_USAGE_RATIO < allocator->getSize();
+}
+
+bool MemoryAllocator::needsDefragmentation() {
+    // Called every frame, only the chunks' used sizes are checked so other threads can keep allocating
+    std::shared_lock<std::shared_mutex> lock(chunksMutex);
+    uint64_t generation = freeGeneration;
+    for (Chunk* chunk : chunks) {
+        if (chunk->dedicated || chunk->data || chunk->defragmentationFailedGeneration == generation) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> chunkLock(chunk->mutex);
+        if (isSparse(chunk->allocator)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+VkDeviceSize MemoryAllocator::defragment(VkCommandBuffer commandBuffer, VkDeviceSize maxBytes, uint32_t frame, std::vector<Allocation*>& movedAllocations) {
+    std::unique_lock<std::shared_mutex> lock(chunksMutex);
+    // Cached allocations must not be moved as if they were used
+    flushThreadCaches();
+
+    Chunk* chunk = findDefragmentationChunk();
+    if (!chunk) {
+        return 0;
+    }
+
+    // Previous writes must be done before copying
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    backend->cmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 1, &barrier, 0, nullptr);
+
+    // Move allocations out of the chunk until the limit is reached, allocations bigger than the limit stay in place
+    VkDeviceSize movedBytes = 0;
+    for (Block* block = chunk->allocator->getFirstBlock(); block; block = block->nextPhysical) {
+        if (!block->inUse) {
+            continue;
+        }
+
+        Allocation* allocation = (Allocation*)block->userData;
+        if (allocation->size > maxBytes) {
+            continue;
+        }
+        if (movedBytes + allocation->size > maxBytes) {
+            break;
+        }
+
+        bool moved = chunk->buffer != VK_NULL_HANDLE ? moveBuffer(commandBuffer, allocation) : moveImage(commandBuffer, allocation);
+        if (moved) {
+            movedBytes += allocation->size;
+            movedAllocations.push_back(allocation);
+            defragmentationMoves.back().frame = frame;
+        }
+    }
+
+    if (movedBytes == 0) {
+        chunk->defragmentationFailedGeneration = freeGeneration;
+    }
+
+    // Copies must be done before the moved resources are used
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    backend->cmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 1, &barrier, 0, nullptr);
+
+    return movedBytes;
+}
+
+void MemoryAllocator::finishDefragmentation(uint32_t frame) {
+    // Moves are only added by the rendering thread, the lock is not taken when the frame moved nothing
+    if (std::none_of(defragmentationMoves.begin(), defragmentationMoves.end(), [frame](const DefragmentationMove& move) { return move.frame == frame; })) {
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(chunksMutex);
+    // The frame's copies are done and the frames before it do not use the previous places anymore, they can be released
+    std::vector<Chunk*> sourceChunks;
+    for (DefragmentationMove& move : defragmentationMoves) {
+        if (move.frame != frame) {
+            continue;
+        }
+        if (move.image != VK_NULL_HANDLE) {
+            backend->destroyImage(move.image);
+        }
+        move.chunk->allocator->free(move.block);
+        if (std::find(sourceChunks.begin(), sourceChunks.end(), move.chunk) == sourceChunks.end()) {
+            sourceChunks.push_back(move.chunk);
+        }
+    }
+    defragmentationMoves.erase(std::remove_if(defragmentationMoves.begin(), defragmentationMoves.end(), [frame](const DefragmentationMove& move) {
+        return move.frame == frame;
+    }), defragmentationMoves.end());
+
+    for (Chunk* chunk : sourceChunks) {
+        if (chunk->allocator->isEmpty()) {
+            releaseEmptyChunk(chunk);
+        }
+    }
+}
+
+static void addStats(ChunkStats& total, const ChunkStats& stats) {
+    total.size += stats.size;
+    total.usedSize += stats.usedSize;
+    total.freeSize += stats.freeSize;
+    total.cachedSize += stats.cachedSize;
+    total.largestFreeBlock = std::max(total.largestFreeBlock, stats.largestFreeBlock);
+    total.alignmentWaste += stats.alignmentWaste;
+    total.blockCount += stats.blockCount;
+    total.allocationCount += stats.allocationCount;
+    total.fragmentation = total.freeSize != 0 ? 1.0f - (float)total.largestFreeBlock / (float)total.freeSize : 0.0f;
+}
+
+static void writeStats(std::ofstream& file, const ChunkStats& stats, const std::string& indent) {
+    file << indent << "\"size\": " << stats.size << ",\n";
+    file << indent << "\"usedSize\": " << stats.usedSize << ",\n";
+    file << indent << "\"freeSize\": " << stats.freeSize << ",\n";
+    file << indent << "\"cachedSize\": " << stats.cachedSize << ",\n";
+    file << indent << "\"largestFreeBlock\": " << stats.largestFreeBlock << ",\n";
+    file << indent << "\"alignmentWaste\": " << stats.alignmentWaste << ",\n";
+    file << indent << "\"fragmentation\": " << stats.fragmentation << ",\n";
+    file << indent << "\"blockCount\": " << stats.blockCount << ",\n";
+    file << indent << "\"allocationCount\": " << stats.allocationCount;
+}
+
+void MemoryAllocator::startTrace(const std::string& path) {
+    traceFile = new std::ofstream(path);
+    if (!traceFile->is_open()) {
+        delete traceFile;
+        traceFile = nullptr;
+        throw std::runtime_error("Failed to open file " + path + "!");
+    }
+}
+
+MemoryStats MemoryAllocator::getStats() {
+    std::unique_lock<std::shared_mutex> lock(chunksMutex);
+    // Blocks in the threads' caches are counted apart from the used ones
+    std::unordered_set<Block*> cachedBlocks;
+    {
+        std::lock_guard<std::mutex> cachesLock(threadCachesMutex);
+        for (auto& threadCache : threadCaches) {
+            std::lock_guard<std::mutex> cacheLock(threadCache.second->mutex);
+            for (Allocation* allocation : threadCache.second->allocations) {
+                cachedBlocks.insert(allocation->block);
             }
         }
     }
 
-    // No block has been found, create a new chunk
-    Chunk newChunk = Chunk(device, properties, std::max((VkDeviceSize)CHUNK_SIZE, memRequirements.size));
+    MemoryStats stats = {};
+    stats.chunkCount = static_cast<uint32_t>(chunks.size());
 
-    // Add to this chunk
-    VkDeviceSize offset;
-    offset = newChunk.allocate(memRequirements);
+    for (Chunk* chunk : chunks) {
+        ChunkStats chunkStats = {};
+        chunkStats.size = chunk->allocator->getSize();
+        chunkStats.bufferChunk = chunk->buffer != VK_NULL_HANDLE;
+        chunkStats.dedicatedChunk = chunk->dedicated;
+        for (Block* block = chunk->allocator->getFirstBlock(); block; block = block->nextPhysical) {
+            chunkStats.blockCount++;
+            if (block->inUse && cachedBlocks.count(block)) {
+                chunkStats.cachedSize += block->size;
+            }
+            else if (block->inUse) {
+                chunkStats.usedSize += block->size;
+                chunkStats.allocationCount++;
+                // Previous places of moved allocations have no allocation until they are released
+                if (block->userData) {
+                    chunkStats.alignmentWaste += block->size - ((Allocation*)block->userData)->size;
+                }
+            }
+            else {
+                chunkStats.freeSize += block->size;
+                chunkStats.largestFreeBlock = std::max(chunkStats.largestFreeBlock, (VkDeviceSize)block->size);
+            }
+        }
+        chunkStats.fragmentation = chunkStats.freeSize != 0 ? 1.0f - (float)chunkStats.largestFreeBlock / (float)chunkStats.freeSize : 0.0f;
 
-    if (offset == -1) {
-        throw std::runtime_error("Failed to allocate memory (block allocation)!");
+        // Group by memory type
+        MemoryTypeStats* memoryTypeStats = nullptr;
+        for (MemoryTypeStats& otherMemoryTypeStats : stats.memoryTypes) {
+            if (otherMemoryTypeStats.memoryType == (uint32_t)chunk->type) {
+                memoryTypeStats = &otherMemoryTypeStats;
+                break;
+            }
+        }
+        if (!memoryTypeStats) {
+            stats.memoryTypes.push_back({});
+            memoryTypeStats = &stats.memoryTypes.back();
+            memoryTypeStats->memoryType = chunk->type;
+            memoryTypeStats->propertyFlags = memoryProperties.memoryTypes[chunk->type].propertyFlags;
+            memoryTypeStats->heap = memoryProperties.memoryTypes[chunk->type].heapIndex;
+        }
+        memoryTypeStats->chunks.push_back(chunkStats);
+        addStats(memoryTypeStats->total, chunkStats);
+        addStats(stats.total, chunkStats);
+    }
+
+    std::sort(stats.memoryTypes.begin(), stats.memoryTypes.end(), [](const MemoryTypeStats& a, const MemoryTypeStats& b) {
+        return a.memoryType < b.memoryType;
+    });
+
+    std::lock_guard<std::mutex> budgetLock(budgetMutex);
+    stats.heaps.assign(heapBudgets.begin(), heapBudgets.begin() + memoryProperties.memoryHeapCount);
+
+    return stats;
+}
+
+void MemoryAllocator::dumpStats(const std::string& path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file " + path + "!");
+    }
+
+    MemoryStats stats = getStats();
+
+    file << "{\n";
+    file << "  \"chunkCount\": " << stats.chunkCount << ",\n";
+    writeStats(file, stats.total, "  ");
+    file << ",\n  \"memoryTypes\": [";
+    for (size_t i = 0; i < stats.memoryTypes.size(); i++) {
+        MemoryTypeStats& memoryTypeStats = stats.memoryTypes[i];
+        file << (i == 0 ? "\n" : ",\n") << "    {\n";
+        file << "      \"memoryType\": " << memoryTypeStats.memoryType << ",\n";
+        file << "      \"propertyFlags\": " << memoryTypeStats.propertyFlags << ",\n";
+        file << "      \"heap\": " << memoryTypeStats.heap << ",\n";
+        writeStats(file, memoryTypeStats.total, "      ");
+        file << ",\n      \"chunks\": [";
+        for (size_t j = 0; j < memoryTypeStats.chunks.size(); j++) {
+            file << (j == 0 ? "\n" : ",\n") << "        {\n";
+            file << "          \"bufferChunk\": " << (memoryTypeStats.chunks[j].bufferChunk ? "true" : "false") << ",\n";
+            file << "          \"dedicatedChunk\": " << (memoryTypeStats.chunks[j].dedicatedChunk ? "true" : "false") << ",\n";
+            writeStats(file, memoryTypeStats.chunks[j], "          ");
+            file << "\n        }";
+        }
+        file << "\n      ]\n    }";
+    }
+    file << "\n  ],\n  \"heaps\": [";
+    for (size_t i = 0; i < stats.heaps.size(); i++) {
+        file << (i == 0 ? "\n" : ",\n") << "    {\n";
+        file << "      \"heap\": " << i << ",\n";
+        file << "      \"size\": " << memoryProperties.memoryHeaps[i].size << ",\n";
+        file << "      \"budget\": " << stats.heaps[i].budget << ",\n";
+        file << "      \"usage\": " << stats.heaps[i].usage << ",\n";
+        file << "      \"processUsage\": " << stats.heaps[i].processUsage << "\n";
+        file << "    }";
+    }
+    file << "\n  ]\n}\n";
+}
+
+VkBuffer MemoryAllocator::getRingBuffer() {
+    return ringBuffer->buffer;
+}
+
+void MemoryAllocator::mapChunk(Chunk* chunk) {
+    // Host visible chunks are mapped once, allocations get a pointer in the mapping
+    if (memoryProperties.memoryTypes[chunk->type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (backend->mapMemory(chunk->memory, &chunk->data) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to map memory (chunk creation)!");
+        }
+    }
+}
+
+void MemoryAllocator::addChunk(Chunk* chunk) {
+    // The chunks lock is held exclusively
+    {
+        std::lock_guard<std::mutex> lock(budgetMutex);
+        heapBudgets[memoryProperties.memoryTypes[chunk->type].heapIndex].usage += chunk->size;
+    }
+    mapChunk(chunk);
+    chunks.push_back(chunk);
+}
+
+void MemoryAllocator::destroyChunk(Chunk* chunk) {
+    chunks.erase(std::find(chunks.begin(), chunks.end(), chunk));
+    {
+        std::lock_guard<std::mutex> lock(budgetMutex);
+        heapBudgets[memoryProperties.memoryTypes[chunk->type].heapIndex].usage -= chunk->size;
+    }
+    chunk->freeBlocks();
+    if (chunk->data) {
+        backend->unmapMemory(chunk->memory);
+    }
+    if (chunk->buffer != VK_NULL_HANDLE) {
+        backend->destroyBuffer(chunk->buffer);
+    }
+    backend->freeMemory(chunk->memory);
+    delete chunk;
+}
+
+Chunk* MemoryAllocator::findDefragmentationChunk() {
+    // Sparsest chunk that only holds movable allocations
+    // Mapped chunks are left as they are, the host writes the frame's data in them before the copies are executed
+    Chunk* sparsestChunk = nullptr;
+    for (Chunk* chunk : chunks) {
+        TLSF* allocator = chunk->allocator;
+        if (chunk->dedicated || chunk->data || chunk->defragmentationFailedGeneration == freeGeneration || !isSparse(allocator)) {
+            continue;
+        }
+        if (sparsestChunk && allocator->getUsedSize() >= sparsestChunk->allocator->getUsedSize()) {
+            continue;
+        }
+
+        // Chunks holding allocations that cannot be moved are tried again once memory is freed
+        // Chunks still holding previous places of moved allocations are skipped until they are released
+        bool movable = true;
+        bool moving = false;
+        for (Block* block = allocator->getFirstBlock(); block && movable; block = block->nextPhysical) {
+            if (block->inUse) {
+                Allocation* allocation = (Allocation*)block->userData;
+                moving = moving || !allocation;
+                movable = !allocation || allocation->movable;
+            }
+        }
+        if (!movable) {
+            chunk->defragmentationFailedGeneration = freeGeneration;
+        }
+        else if (!moving) {
+            sparsestChunk = chunk;
+        }
     }
 
-    vkBindBufferMemory(*device, *bufferToAllocate, newChunk.memory, offset);
+    return sparsestChunk;
+}
+
+bool MemoryAllocator::moveBuffer(VkCommandBuffer commandBuffer, Allocation* allocation) {
+    Chunk* srcChunk = allocation->chunk;
+
+    VkMemoryRequirements memRequirements;
+    memRequirements.size = getBufferBlockSize(allocation->size);
+    memRequirements.alignment = getBufferAlignment(srcChunk->usage);
+    memRequirements.memoryTypeBits = 0;
+
+    // Only move to chunks more used than the source to not move back and forth
+    for (Chunk* chunk : chunks) {
+        if (chunk == srcChunk || chunk->buffer == VK_NULL_HANDLE || chunk->usage != srcChunk->usage || chunk->flags != srcChunk->flags || chunk->allocator->getUsedSize() < srcChunk->allocator->getUsedSize()) {
+            continue;
+        }
+
+        Block* block = chunk->allocate(memRequirements);
+        if (!block) {
+            continue;
+        }
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.srcOffset = allocation->offset;
+        copyRegion.dstOffset = block->offset + block->padding;
+        copyRegion.size = allocation->size;
+        backend->cmdCopyBuffer(commandBuffer, srcChunk->buffer, chunk->buffer, 1, &copyRegion);
+
+        defragmentationMoves.push_back({ srcChunk, allocation->block, VK_NULL_HANDLE, 0 });
+        allocation->block->userData = nullptr;
+
+        block->userData = allocation;
+        allocation->chunk = chunk;
+        allocation->block = block;
+        allocation->buffer = chunk->buffer;
+        allocation->offset = copyRegion.dstOffset;
 
-    chunks.push_back(newChunk);
+        return true;
+    }
 
-    return 1;
+    return false;
 }
 
-VkDeviceSize MemoryAllocator::allocate(VkImage* imageToAllocate, VkMemoryPropertyFlags flags) {
+bool MemoryAllocator::moveImage(VkCommandBuffer commandBuffer, Allocation* allocation) {
+    Chunk* srcChunk = allocation->chunk;
+
+    VkImage image;
+    if (backend->createImage(&allocation->imageInfo, &image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create image (defragmentation)!");
+    }
+
     VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(*device, *imageToAllocate, &memRequirements);
-    int32_t properties = findProperties(memRequirements.memoryTypeBits, flags);
-
-    // Look for the first block with enough space
-    for (Chunk chunk : chunks) {
-        if (chunk.type == properties) {
-            VkDeviceSize offset;
-            offset = chunk.allocate(memRequirements);
-
-            if (offset != -1) {
-                vkBindImageMemory(*device, *imageToAllocate, chunk.memory, offset);
-                return 1;
+    backend->getImageMemoryRequirements(image, &memRequirements);
+
+    // Only move to chunks more used than the source to not move back and forth
+    for (Chunk* chunk : chunks) {
+        if (chunk == srcChunk || chunk->buffer != VK_NULL_HANDLE || chunk->dedicated || chunk->linear != srcChunk->linear || chunk->type != srcChunk->type || chunk->allocator->getUsedSize() < srcChunk->allocator->getUsedSize()) {
+            continue;
+        }
+
+        Block* block = chunk->allocate(memRequirements);
+        if (!block) {
+            continue;
+        }
+        VkDeviceSize offset = block->offset + block->padding;
+        backend->bindImageMemory(image, chunk->memory, offset);
+
+        // Only color images are moved
+        std::array<VkImageMemoryBarrier, 2> barriers = {};
+        for (VkImageMemoryBarrier& barrier : barriers) {
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.baseMipLevel = 0;
+            barrier.subresourceRange.levelCount = allocation->imageInfo.mipLevels;
+            barrier.subresourceRange.baseArrayLayer = 0;
+            barrier.subresourceRange.layerCount = allocation->imageInfo.arrayLayers;
+        }
+        barriers[0].image = allocation->image;
+        barriers[0].oldLayout = allocation->imageLayout;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+        barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[1].image = image;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].srcAccessMask = 0;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        backend->cmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+        // Every mip level is copied
+        std::vector<VkImageCopy> regions;
+        for (uint32_t i = 0; i < allocation->imageInfo.mipLevels; i++) {
+            VkImageCopy region = {};
+            region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.srcSubresource.mipLevel = i;
+            region.srcSubresource.baseArrayLayer = 0;
+            region.srcSubresource.layerCount = allocation->imageInfo.arrayLayers;
+            region.dstSubresource = region.srcSubresource;
+            region.extent.width = std::max(allocation->imageInfo.extent.width >> i, 1U);
+            region.extent.height = std::max(allocation->imageInfo.extent.height >> i, 1U);
+            region.extent.depth = std::max(allocation->imageInfo.extent.depth >> i, 1U);
+            regions.push_back(region);
+        }
+        backend->cmdCopyImage(commandBuffer, allocation->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].newLayout = allocation->imageLayout;
+        barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        backend->cmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, nullptr, 1, &barriers[1]);
+
+        // The previous image is destroyed when the copy is done
+        defragmentationMoves.push_back({ srcChunk, allocation->block, allocation->image, 0 });
+        allocation->block->userData = nullptr;
+
+        block->userData = allocation;
+        allocation->chunk = chunk;
+        allocation->block = block;
+        allocation->offset = offset;
+        allocation->size = memRequirements.size;
+        allocation->image = image;
+
+        return true;
+    }
+
+    backend->destroyImage(image);
+    return false;
+}
+
+bool MemoryAllocator::isCompatibleMemoryType(int32_t memoryType, uint32_t memoryTypeBits, VkMemoryPropertyFlags flags) {
+    return (memoryTypeBits & (1 << memoryType)) && (memoryProperties.memoryTypes[memoryType].propertyFlags & flags) == flags;
+}
+
+int32_t MemoryAllocator::findChunkMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags flags, VkDeviceSize size) {
+    int32_t memoryType = findProperties(memoryTypeBits, flags);
+    uint32_t heap = memoryProperties.memoryTypes[memoryType].heapIndex;
+    if (isInBudget(heap, size)) {
+        return memoryType;
+    }
+
+    // Make room in the heap, empty chunks kept in reserve first, then resources the owners can drop
+    releaseReserveChunks(heap);
+    while (!isInBudget(heap, size) && evictionCallback && evictionCallback(evictionUserData, heap, size)) {
+        // Chunks emptied by the callback are kept in reserve
+        releaseReserveChunks(heap);
+    }
+    if (isInBudget(heap, size)) {
+        return memoryType;
+    }
+
+    // Another memory type with the flags may be in a heap with space left
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & flags) == flags && isInBudget(memoryProperties.memoryTypes[i].heapIndex, size)) {
+            return static_cast<int32_t>(i);
+        }
+    }
+
+    // Device local memory is redirected to system memory
+    if (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+        VkMemoryPropertyFlags hostFlags = flags & ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & hostFlags) == hostFlags && isInBudget(memoryProperties.memoryTypes[i].heapIndex, size)) {
+                return static_cast<int32_t>(i);
             }
         }
     }
 
-    // No block has been found, create a new chunk
-    Chunk newChunk = Chunk(device, properties, std::max((VkDeviceSize)CHUNK_SIZE, memRequirements.size));
+    throw std::runtime_error("Failed to allocate memory (heap budget exceeded)!");
+}
 
-    // Add to this chunk
-    VkDeviceSize offset;
-    offset = newChunk.allocate(memRequirements);
+bool MemoryAllocator::isInBudget(uint32_t heap, VkDeviceSize size) {
+    std::lock_guard<std::mutex> lock(budgetMutex);
+    // The process usage is only known when the budget is queried, the allocator's own changes since then are added
+    const HeapBudget& heapBudget = heapBudgets[heap];
+    VkDeviceSize usage = heapBudget.processUsage + heapBudget.usage - heapBudget.queriedUsage;
+    return usage + size <= heapBudget.budget;
+}
 
-    if (offset == -1) {
-        throw std::runtime_error("Failed to allocate memory (block allocation)!");
+void MemoryAllocator::releaseReserveChunks(uint32_t heap) {
+    std::unique_lock<std::shared_mutex> lock(chunksMutex);
+    // Blocks cached by the threads, exited ones included, may be all that keeps a chunk alive
+    flushThreadCaches();
+    for (size_t i = chunks.size(); i > 0; i--) {
+        Chunk* chunk = chunks[i - 1];
+        if (memoryProperties.memoryTypes[chunk->type].heapIndex == heap && chunk->allocator->isEmpty()) {
+            destroyChunk(chunk);
+        }
+    }
+}
+
+ThreadCache* MemoryAllocator::getThreadCache() {
+    // Looked up once per thread, the allocator id tells if the cache belongs to this allocator
+    thread_local uint64_t cacheAllocatorId = 0;
+    thread_local ThreadCache* cache = nullptr;
+    if (cacheAllocatorId != allocatorId) {
+        std::lock_guard<std::mutex> lock(threadCachesMutex);
+        ThreadCache*& threadCache = threadCaches[std::this_thread::get_id()];
+        if (!threadCache) {
+            threadCache = new ThreadCache();
+        }
+        cache = threadCache;
+        cacheAllocatorId = allocatorId;
+    }
+
+    return cache;
+}
+
+Allocation* MemoryAllocator::allocateFromThreadCache(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags) {
+    if (size > THREAD_CACHE_MAX_SIZE) {
+        return nullptr;
+    }
+
+    ThreadCache* cache = getThreadCache();
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    VkDeviceSize sizeClass = getBufferBlockSize(size);
+    // Most recently freed first
+    for (size_t i = cache->allocations.size(); i > 0; i--) {
+        Allocation* allocation = cache->allocations[i - 1];
+        if (allocation->chunk->usage == usage && allocation->chunk->flags == flags && getBufferBlockSize(allocation->size) == sizeClass) {
+            cache->allocations.erase(cache->allocations.begin() + (i - 1));
+            allocation->id = nextAllocationId++;
+            allocation->size = size;
+
+            return allocation;
+        }
     }
 
-    vkBindImageMemory(*device, *imageToAllocate, newChunk.memory, offset);
+    return nullptr;
+}
+
+bool MemoryAllocator::freeToThreadCache(Allocation* allocation) {
+    if (allocation->chunk->buffer == VK_NULL_HANDLE || allocation->size > THREAD_CACHE_MAX_SIZE) {
+        return false;
+    }
 
-    chunks.push_back(newChunk);
+    ThreadCache* cache = getThreadCache();
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    if (cache->allocations.size() >= THREAD_CACHE_CAPACITY) {
+        return false;
+    }
+    cache->allocations.push_back(allocation);
 
-    return 1;
+    return true;
 }
 
-void MemoryAllocator::free() {
-    for (Chunk chunk : chunks) {
-        chunk.freeBlocks();
-        vkFreeMemory(*device, chunk.memory, nullptr);
+void MemoryAllocator::flushThreadCaches() {
+    // The chunks lock is held exclusively
+    std::lock_guard<std::mutex> lock(threadCachesMutex);
+    for (auto& threadCache : threadCaches) {
+        std::lock_guard<std::mutex> cacheLock(threadCache.second->mutex);
+        for (Allocation* allocation : threadCache.second->allocations) {
+            Chunk* chunk = allocation->chunk;
+            chunk->allocator->free(allocation->block);
+            delete allocation;
+
+            if (chunk->allocator->isEmpty()) {
+                releaseEmptyChunk(chunk);
+            }
+        }
+        threadCache.second->allocations.clear();
     }
 }
 
@@ -1,40 +1,244 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
 #include <vector>
+#include <array>
+#include <string>
+#include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include "TLSF.h"
+#include "MemoryBackend.h"
 
 // 256 MB
 #define CHUNK_SIZE 268435456
+// 64 MB, chunks holding a buffer for sub-allocation
+#define BUFFER_CHUNK_SIZE 67108864
+// 32 MB, resources at least this big get their own memory
+#define DEDICATED_ALLOCATION_SIZE 33554432
+// Empty chunks kept per memory type to avoid reallocating device memory
+#define MAX_EMPTY_CHUNKS 1
+// Part of a heap's size used as its budget when the device does not give one
+#define HEAP_BUDGET_RATIO 0.8
+// Buffer sub-allocations up to this size are rounded up to a power of two and cached by the thread freeing them
+#define THREAD_CACHE_MAX_SIZE 4096
+// Allocations kept in each thread's cache
+#define THREAD_CACHE_CAPACITY 64
+// Chunks used at less than 1 / DEFRAGMENTATION_USAGE_RATIO are emptied by the defragmentation
+#define DEFRAGMENTATION_USAGE_RATIO 4
 
-struct Block {
-	Block* next;
+struct Chunk {
+	VkDeviceMemory memory;
+	int32_t type;
+	// Size of the memory, the allocator of a buffer chunk only covers the buffer
+	VkDeviceSize size;
+	TLSF* allocator;
+	// Guards the allocator's blocks, taken with the MemoryAllocator's chunks lock held
+	std::mutex mutex;
+	// Mapped once for the chunk's lifetime if the memory is host visible, nullptr otherwise
+	void* data;
 
+	// Buffer covering the whole chunk, VK_NULL_HANDLE if resources are bound directly to the memory
+	VkBuffer buffer;
+	VkBufferUsageFlags usage;
+	VkMemoryPropertyFlags flags;
+
+	// Buffers and linear images are never placed with optimal images so bufferImageGranularity does not apply
+	bool linear;
+	// Memory allocated for a single resource, released with it
+	bool dedicated;
+
+	// Allocator's free generation when the defragmentation could not move anything out of this chunk, it is tried again once memory is freed
+	uint64_t defragmentationFailedGeneration;
+
+	Chunk(MemoryBackend* backend, int32_t memoryType, VkDeviceSize size, bool linearResources, const VkMemoryDedicatedAllocateInfo* dedicatedInfo);
+	Chunk(MemoryBackend* backend, int32_t memoryType, VkDeviceSize size, VkBuffer chunkBuffer, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferFlags);
+	Block* allocate(VkMemoryRequirements memRequirements);
+	void freeBlocks();
+};
+
+// Handle given by the allocator, used to free the memory
+struct Allocation {
+	uint64_t id;
+	Chunk* chunk;
+	Block* block;
+	// Buffer and offset in it for buffer sub-allocations, offset in the chunk's memory otherwise
+	VkBuffer buffer;
 	VkDeviceSize offset;
 	VkDeviceSize size;
-	bool inUse;
+
+	// Image bound to the allocation, recreated by the defragmentation when the allocation is moved
+	VkImage image;
+	VkImageCreateInfo imageInfo;
+	VkImageLayout imageLayout;
+	// Buffer sub-allocations are always movable, images only when their creation info is known
+	bool movable;
 };
 
-struct Chunk {
+// Previous place of a moved allocation, released once the frame whose command buffer holds the copy is done
+struct DefragmentationMove {
+	Chunk* chunk;
+	Block* block;
+	VkImage image;
+	uint32_t frame;
+};
+
+// Sizes are in bytes
+struct ChunkStats {
+	VkDeviceSize size;
+	VkDeviceSize usedSize;
+	VkDeviceSize freeSize;
+	// Blocks kept in the threads' caches, neither used nor free
+	VkDeviceSize cachedSize;
+	VkDeviceSize largestFreeBlock;
+	// Space in used blocks not used by their allocation (alignment padding and remainders too small to be split)
+	VkDeviceSize alignmentWaste;
+	// 0 when the free space is in one block, close to 1 when it is split in many small blocks
+	float fragmentation;
+	uint32_t blockCount;
+	uint32_t allocationCount;
+	bool bufferChunk;
+	bool dedicatedChunk;
+};
+
+struct MemoryTypeStats {
+	uint32_t memoryType;
+	VkMemoryPropertyFlags propertyFlags;
+	uint32_t heap;
+	ChunkStats total;
+	std::vector<ChunkStats> chunks;
+};
+
+struct HeapBudget {
+	// Memory of the heap the allocator can use
+	VkDeviceSize budget;
+	// Memory allocated by the allocator
+	VkDeviceSize usage;
+	// Memory used by the whole process when the budget has been queried and the allocator's usage at that time
+	VkDeviceSize processUsage;
+	VkDeviceSize queriedUsage;
+	// Limit given with setHeapBudget, 0 if there is none
+	VkDeviceSize userBudget;
+};
+
+struct MemoryStats {
+	ChunkStats total;
+	uint32_t chunkCount;
+	// Memory types with at least one chunk
+	std::vector<MemoryTypeStats> memoryTypes;
+	std::vector<HeapBudget> heaps;
+};
+
+// Small buffer sub-allocations freed by a thread, reused by its next allocations of the same size class without locking the chunks
+// The lock is only contended when the caches are flushed
+struct ThreadCache {
+	std::mutex mutex;
+	std::vector<Allocation*> allocations;
+};
+
+// Called when a new chunk would go over the heap's budget, returns true if resources have been freed
+// Called again until the heap has space or nothing has been freed, the allocator is not locked so the callback can free allocations
+typedef bool (*EvictionCallback)(void* userData, uint32_t heap, VkDeviceSize size);
+
+// Persistently mapped host visible buffer for data written every frame
+// Split in one region per frame in flight, a region is reused when its frame's fence signaled
+struct RingBuffer {
+	VkBuffer buffer;
 	VkDeviceMemory memory;
-	int32_t type;
-	Block* head;
+	uint32_t memoryType;
+	VkDeviceSize memorySize;
+	void* data;
 
-	Chunk(VkDevice* device, int32_t memoryType, VkDeviceSize size);
-	VkDeviceSize allocate(VkMemoryRequirements memRequirements);
-	void freeBlocks();
+	VkDeviceSize frameSize;
+	VkDeviceSize alignment;
+	// Beginning of the current frame's region and next free offset in it
+	VkDeviceSize frameOffset;
+	VkDeviceSize offset;
 };
 
+// Allocations and frees can be done from any thread
+// The defragmentation, the stats and the ring buffer are used from the rendering thread only
 class MemoryAllocator {
 public:
-	void setDevice(VkDevice* newDevice);
+	MemoryAllocator();
+	void setBackend(MemoryBackend* newBackend);
 	void setPhysicalDeviceMemoryProperties(VkPhysicalDeviceMemoryProperties newPhysicalDeviceMemoryProperties);
-	VkDeviceSize allocate(VkBuffer* bufferToAllocate, VkMemoryPropertyFlags flags);
-	VkDeviceSize allocate(VkImage* imageToAllocate, VkMemoryPropertyFlags flags);
+	void setPhysicalDeviceLimits(VkPhysicalDeviceLimits newPhysicalDeviceLimits);
+	// Limits the memory the allocator uses in a heap, 0 removes the limit
+	void setHeapBudget(uint32_t heap, VkDeviceSize budget);
+	void setEvictionCallback(EvictionCallback callback, void* userData);
+	// Queries the device's budget, done every frame by beginFrame
+	void updateBudget();
+	Allocation* allocate(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags);
+	Allocation* allocate(VkBuffer* bufferToAllocate, VkMemoryPropertyFlags flags);
+	// Dedicated images get their own memory, so do images the driver wants dedicated and images bigger than DEDICATED_ALLOCATION_SIZE
+	Allocation* allocate(VkImage* imageToAllocate, VkImageTiling tiling, VkMemoryPropertyFlags flags, bool dedicated);
+	void free(Allocation* allocation);
 	void free();
+	void* mappedPtr(Allocation* allocation);
+	void setMovable(Allocation* allocation, VkImageCreateInfo imageInfo, VkImageLayout imageLayout);
+	bool needsDefragmentation();
+	// Copies are recorded in the frame's command buffer, the moved allocations are added to movedAllocations
+	VkDeviceSize defragment(VkCommandBuffer commandBuffer, VkDeviceSize maxBytes, uint32_t frame, std::vector<Allocation*>& movedAllocations);
+	// Releases the previous places of the allocations moved in this frame, once its fence signaled
+	void finishDefragmentation(uint32_t frame);
+	MemoryStats getStats();
+	void dumpStats(const std::string& path);
+	// Every allocation and free is written in the file, to be replayed by the benchmarks
+	void startTrace(const std::string& path);
+	void createRingBuffer(VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usage, VkDeviceSize alignment);
+	void beginFrame(uint32_t frame);
+	VkDeviceSize ringAllocate(VkDeviceSize size, void** data);
+	VkBuffer getRingBuffer();
 	int32_t findProperties(uint32_t memoryTypeBitsRequirement, VkMemoryPropertyFlags requiredProperties);
 private:
-	VkDevice* device;
+	Allocation* allocate(VkMemoryRequirements memRequirements, VkMemoryPropertyFlags flags, bool linear);
+	Allocation* allocateDedicated(VkMemoryRequirements memRequirements, VkMemoryPropertyFlags flags, bool linear, VkBuffer buffer, VkImage image);
+	bool allocateInChunk(Chunk* chunk, VkMemoryRequirements memRequirements, Allocation* allocation);
+	Chunk* createBufferChunk(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags);
+	VkDeviceSize getBufferAlignment(VkBufferUsageFlags usage);
+	void addChunk(Chunk* chunk);
+	void mapChunk(Chunk* chunk);
+	int32_t findChunkMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags flags, VkDeviceSize size);
+	// Chunks of any memory type allowed by the requirements and having the flags can hold the allocation
+	bool isCompatibleMemoryType(int32_t memoryType, uint32_t memoryTypeBits, VkMemoryPropertyFlags flags);
+	bool isInBudget(uint32_t heap, VkDeviceSize size);
+	void releaseReserveChunks(uint32_t heap);
+	VkDeviceSize getBufferBlockSize(VkDeviceSize size);
+	ThreadCache* getThreadCache();
+	Allocation* allocateFromThreadCache(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags);
+	bool freeToThreadCache(Allocation* allocation);
+	void flushThreadCaches();
+	void releaseEmptyChunk(Chunk* chunk);
+	void destroyChunk(Chunk* chunk);
+	Chunk* findDefragmentationChunk();
+	bool moveBuffer(VkCommandBuffer commandBuffer, Allocation* allocation);
+	bool moveImage(VkCommandBuffer commandBuffer, Allocation* allocation);
+
+	MemoryBackend* backend = nullptr;
 	VkPhysicalDeviceMemoryProperties memoryProperties;
-	std::vector<Chunk> chunks;
+	std::array<HeapBudget, VK_MAX_MEMORY_HEAPS> heapBudgets = {};
+	EvictionCallback evictionCallback = nullptr;
+	void* evictionUserData = nullptr;
+	VkPhysicalDeviceLimits limits;
+	std::vector<Chunk*> chunks;
+	// Shared to look for space in the chunks, exclusive to add or remove chunks and to move allocations
+	std::shared_mutex chunksMutex;
+	std::mutex budgetMutex;
+	std::mutex traceMutex;
+	std::mutex threadCachesMutex;
+	std::unordered_map<std::thread::id, ThreadCache*> threadCaches;
+	// Incremented by every free so chunks the defragmentation failed on are tried again
+	std::atomic<uint64_t> freeGeneration{ 1 };
+	// Changes when the caches are destroyed so threads do not use them anymore
+	uint64_t allocatorId;
+	std::vector<DefragmentationMove> defragmentationMoves;
+	RingBuffer* ringBuffer = nullptr;
+	std::atomic<uint64_t> nextAllocationId{ 0 };
+	std::ofstream* traceFile = nullptr;
 };
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+// Device operations used by the MemoryAllocator
+// The allocator only works with offsets and sizes, the backend does the actual calls to the device
+class MemoryBackend {
+public:
+	virtual ~MemoryBackend() {}
+
+	virtual VkResult allocateMemory(const VkMemoryAllocateInfo* allocInfo, VkDeviceMemory* memory) = 0;
+	virtual void freeMemory(VkDeviceMemory memory) = 0;
+	// The whole memory is mapped
+	virtual VkResult mapMemory(VkDeviceMemory memory, void** data) = 0;
+	virtual void unmapMemory(VkDeviceMemory memory) = 0;
+
+	virtual VkResult createBuffer(const VkBufferCreateInfo* bufferInfo, VkBuffer* buffer) = 0;
+	virtual void destroyBuffer(VkBuffer buffer) = 0;
+	virtual void getBufferMemoryRequirements(VkBuffer buffer, VkMemoryRequirements* memRequirements) = 0;
+	virtual VkResult bindBufferMemory(VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset) = 0;
+
+	virtual VkResult createImage(const VkImageCreateInfo* imageInfo, VkImage* image) = 0;
+	virtual void destroyImage(VkImage image) = 0;
+	virtual void getImageMemoryRequirements(VkImage image, VkMemoryRequirements* memRequirements) = 0;
+	virtual VkResult bindImageMemory(VkImage image, VkDeviceMemory memory, VkDeviceSize offset) = 0;
+
+	// True if the driver prefers or requires the resource to have its own memory (VK_KHR_dedicated_allocation)
+	virtual bool prefersDedicatedBuffer(VkBuffer buffer) = 0;
+	virtual bool prefersDedicatedImage(VkImage image) = 0;
+	// Budget and usage of every heap (VK_EXT_memory_budget), false if the device does not give them
+	virtual bool getMemoryBudget(VkDeviceSize* heapBudgets, VkDeviceSize* heapUsages) = 0;
+
+	virtual void cmdCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy* regions) = 0;
+	virtual void cmdCopyImage(VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageCopy* regions) = 0;
+	virtual void cmdPipelineBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, uint32_t memoryBarrierCount, const VkMemoryBarrier* memoryBarriers, uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* imageMemoryBarriers) = 0;
+};
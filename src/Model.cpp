@@ -1,12 +1,22 @@
 #include "Model.h"
+#include <algorithm>
+#include <cmath>
 
 Model::Model() {
 	modelPath = "";
+	std::fill(aabbMin, aabbMin + 3, 0.0f);
+	std::fill(aabbMax, aabbMax + 3, 0.0f);
+	std::fill(boundingSphere, boundingSphere + 4, 0.0f);
+	index = 0;
 	constructed = false;
 }
 
 Model::Model(std::string mPath) {
 	modelPath = mPath;
+	std::fill(aabbMin, aabbMin + 3, 0.0f);
+	std::fill(aabbMax, aabbMax + 3, 0.0f);
+	std::fill(boundingSphere, boundingSphere + 4, 0.0f);
+	index = 0;
 	constructed = false;
 }
 
@@ -36,8 +46,37 @@ std::vector<Mesh>& Model::getMeshes() {
 	return meshes;
 }
 
-void Model::addMesh(uint64_t indexOffset, uint64_t indexSize) {
-	meshes.push_back({indexOffset, indexSize});
+void Model::addMesh(uint64_t indexOffset, uint64_t indexSize, const float* meshAABBMin, const float* meshAABBMax, const float* meshBoundingSphere) {
+	meshes.push_back({ indexOffset, indexSize,
+		{ meshAABBMin[0], meshAABBMin[1], meshAABBMin[2] },
+		{ meshAABBMax[0], meshAABBMax[1], meshAABBMax[2] },
+		{ meshBoundingSphere[0], meshBoundingSphere[1], meshBoundingSphere[2], meshBoundingSphere[3] } });
+
+	// The model's box holds every mesh's box, its sphere is centered on it and holds every mesh's sphere
+	for (int i = 0; i < 3; i++) {
+		aabbMin[i] = meshes.size() == 1 ? meshAABBMin[i] : std::min(aabbMin[i], meshAABBMin[i]);
+		aabbMax[i] = meshes.size() == 1 ? meshAABBMax[i] : std::max(aabbMax[i], meshAABBMax[i]);
+		boundingSphere[i] = (aabbMin[i] + aabbMax[i]) * 0.5f;
+	}
+	boundingSphere[3] = 0.0f;
+	for (Mesh& mesh : meshes) {
+		float dX = mesh.boundingSphere[0] - boundingSphere[0];
+		float dY = mesh.boundingSphere[1] - boundingSphere[1];
+		float dZ = mesh.boundingSphere[2] - boundingSphere[2];
+		boundingSphere[3] = std::max(boundingSphere[3], std::sqrt(dX * dX + dY * dY + dZ * dZ) + mesh.boundingSphere[3]);
+	}
+}
+
+const float* Model::getAABBMin() {
+	return aabbMin;
+}
+
+const float* Model::getAABBMax() {
+	return aabbMax;
+}
+
+const float* Model::getBoundingSphere() {
+	return boundingSphere;
 }
 
 uint64_t Model::getVertexOffset() {
@@ -48,6 +87,14 @@ void Model::setVertexOffset(uint64_t newVertexOffset) {
 	vertexOffset = newVertexOffset;
 }
 
+uint32_t Model::getIndex() {
+	return index;
+}
+
+void Model::setIndex(uint32_t newIndex) {
+	index = newIndex;
+}
+
 bool Model::isConstructed() {
 	return constructed;
 }
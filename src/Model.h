@@ -5,6 +5,10 @@
 struct Mesh {
 	uint64_t indexOffset;
 	uint64_t indexSize;
+	// Bounding box and sphere, center (xyz) and radius (w), in model space
+	float aabbMin[3];
+	float aabbMax[3];
+	float boundingSphere[4];
 };
 
 class Model {
@@ -20,11 +24,19 @@ public:
 	std::vector<uint32_t>& getParametricMeshIndices();
 
 	std::vector<Mesh>& getMeshes();
-	void addMesh(uint64_t indexOffset, uint64_t indexSize);
+	void addMesh(uint64_t indexOffset, uint64_t indexSize, const float* aabbMin, const float* aabbMax, const float* boundingSphere);
+
+	// Bounds of every mesh, in model space
+	const float* getAABBMin();
+	const float* getAABBMax();
+	const float* getBoundingSphere();
 
 	uint64_t getVertexOffset();
 	void setVertexOffset(uint64_t newVertexOffset);
 
+	uint32_t getIndex();
+	void setIndex(uint32_t newIndex);
+
 	bool isConstructed();
 	void constructedTrue();
 private:
@@ -35,8 +47,15 @@ private:
 
 	std::vector<Mesh> meshes;
 
+	float aabbMin[3];
+	float aabbMax[3];
+	float boundingSphere[4];
+
 	uint64_t vertexOffset;
 
+	// Place of the model in the renderer's construction order, used to sort the draws
+	uint32_t index;
+
 	bool constructed;
 };
 
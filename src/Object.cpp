@@ -1,4 +1,6 @@
 #include "Object.h"
+#include "../external/glm/glm/glm.hpp"
+#include "../external/glm/glm/gtc/matrix_transform.hpp"
 
 Object::Object(float x, float y, float z, float mScale) {
 	posX = x;
@@ -12,6 +14,10 @@ Object::Object(float x, float y, float z, float mScale) {
 	model = nullptr;
 	material = nullptr;
 	frameEvent = nullptr;
+	objectBufferIndex = 0;
+	dirty = true;
+	version = 1;
+	boundsVersion = 0;
 }
 
 Object::Object(float x, float y, float z, float mScale, float xRot, float yRot, float zRot) {
@@ -26,6 +32,10 @@ Object::Object(float x, float y, float z, float mScale, float xRot, float yRot,
 	model = nullptr;
 	material = nullptr;
 	frameEvent = nullptr;
+	objectBufferIndex = 0;
+	dirty = true;
+	version = 1;
+	boundsVersion = 0;
 }
 
 void Object::move(float x, float y, float z) {
@@ -37,6 +47,8 @@ void Object::move(float x, float y, float z) {
 	posX = posX + x;
 	posY = posY + y;
 	posZ = posZ + z;
+	dirty = true;
+	version++;
 }
 
 float Object::getPositionX() {
@@ -55,6 +67,8 @@ void Object::setPosition(float newX, float newY, float newZ) {
 	posX = newX;
 	posY = newY;
 	posZ = newZ;
+	dirty = true;
+	version++;
 }
 
 float Object::getScale() {
@@ -77,6 +91,8 @@ void Object::setRotation(float newRotX, float newRotY, float newRotZ) {
 	rotX = newRotX;
 	rotY = newRotY;
 	rotZ = newRotZ;
+	dirty = true;
+	version++;
 }
 
 SGNode* Object::getNode() {
@@ -93,6 +109,7 @@ Model* Object::getModel() {
 
 void Object::setModel(Model *newModel) {
 	model = newModel;
+	boundsVersion = 0;
 }
 
 Material* Object::getMaterial() {
@@ -111,20 +128,24 @@ void Object::setName(std::string newName) {
 	name = newName;
 }
 
-std::vector<VkDescriptorSet>* Object::getDescriptorSets() {
-	return &descriptorSets;
+uint32_t Object::getObjectBufferIndex() {
+	return objectBufferIndex;
 }
 
-std::vector<VkDescriptorSet>* Object::getShadowsDescriptorSets() {
-	return &shadowsDescriptorSets;
+void Object::setObjectBufferIndex(uint32_t newObjectBufferIndex) {
+	objectBufferIndex = newObjectBufferIndex;
 }
 
-std::vector<VkBuffer>* Object::getObjectBuffers() {
-	return &objectBuffers;
+bool Object::isDirty() {
+	return dirty;
 }
 
-std::vector<VkDeviceMemory>* Object::getObjectBufferMemories() {
-	return &objectBufferMemories;
+void Object::setDirty(bool newDirty) {
+	dirty = newDirty;
+}
+
+uint64_t Object::getVersion() {
+	return version;
 }
 
 int Object::getGraphicsPipelineIndex() {
@@ -133,4 +154,53 @@ int Object::getGraphicsPipelineIndex() {
 
 void Object::setGraphicsPipelineIndex(int newGraphicsPipelineIndex) {
 	graphicsPipelineIndex = newGraphicsPipelineIndex;
+}
+
+const float* Object::getWorldAABBMin() {
+	updateWorldBounds();
+	return worldAABBMin;
+}
+
+const float* Object::getWorldAABBMax() {
+	updateWorldBounds();
+	return worldAABBMax;
+}
+
+const float* Object::getWorldBoundingSphere() {
+	updateWorldBounds();
+	return worldBoundingSphere;
+}
+
+void Object::updateWorldBounds() {
+	if (boundsVersion == version || !model) {
+		return;
+	}
+	boundsVersion = version;
+
+	// Same T * R * S transformation as the renderer
+	glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(posX, posY, posZ));
+	transform = glm::rotate(transform, glm::radians(rotX), glm::vec3(1.0f, 0.0f, 0.0f));
+	transform = glm::rotate(transform, glm::radians(rotY), glm::vec3(0.0f, 1.0f, 0.0f));
+	transform = glm::rotate(transform, glm::radians(rotZ), glm::vec3(0.0f, 0.0f, 1.0f));
+	transform = glm::scale(transform, glm::vec3(scale));
+
+	// Box holding the transformed model's box, its half size on each axis is the sum of the absolute matrix terms times the half size
+	const float* aabbMin = model->getAABBMin();
+	const float* aabbMax = model->getAABBMax();
+	glm::vec3 center = glm::vec3(aabbMin[0] + aabbMax[0], aabbMin[1] + aabbMax[1], aabbMin[2] + aabbMax[2]) * 0.5f;
+	glm::vec3 extent = glm::vec3(aabbMax[0] - aabbMin[0], aabbMax[1] - aabbMin[1], aabbMax[2] - aabbMin[2]) * 0.5f;
+	glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent = glm::abs(glm::mat3(transform)) * extent;
+	for (int i = 0; i < 3; i++) {
+		worldAABBMin[i] = worldCenter[i] - worldExtent[i];
+		worldAABBMax[i] = worldCenter[i] + worldExtent[i];
+	}
+
+	// The scale is uniform so the sphere keeps its shape
+	const float* boundingSphere = model->getBoundingSphere();
+	glm::vec3 sphereCenter = glm::vec3(transform * glm::vec4(boundingSphere[0], boundingSphere[1], boundingSphere[2], 1.0f));
+	for (int i = 0; i < 3; i++) {
+		worldBoundingSphere[i] = sphereCenter[i];
+	}
+	worldBoundingSphere[3] = boundingSphere[3] * std::abs(scale);
 }
\ No newline at end of file
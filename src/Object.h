@@ -28,15 +28,22 @@ public:
 	void setModel(Model *newModel);
 	Material* getMaterial();
 	void setMaterial(Material* newMaterial);
-	std::vector<VkDescriptorSet>* getDescriptorSets();
-	std::vector<VkDescriptorSet>* getShadowsDescriptorSets();
-	std::vector<VkBuffer>* getObjectBuffers();
-	std::vector<VkDeviceMemory>* getObjectBufferMemories();
+	uint32_t getObjectBufferIndex();
+	void setObjectBufferIndex(uint32_t newObjectBufferIndex);
+	bool isDirty();
+	void setDirty(bool newDirty);
+	uint64_t getVersion();
 	int getGraphicsPipelineIndex();
 	void setGraphicsPipelineIndex(int newGraphicsPipelineIndex);
+	// Bounds of the model in world space, computed again when the transform changed
+	const float* getWorldAABBMin();
+	const float* getWorldAABBMax();
+	const float* getWorldBoundingSphere();
 
 	void (*frameEvent)(Object *obj, GLFWwindow* window, double deltaTime);
 private:
+	void updateWorldBounds();
+
 	Model* model;
 	Material* material;
 
@@ -52,11 +59,19 @@ private:
 
 	float scale;
 
-	std::vector<VkBuffer> objectBuffers;
-	std::vector<VkDeviceMemory> objectBufferMemories;
+	// Place of the object's data in the renderer's object buffer
+	uint32_t objectBufferIndex;
+
+	// Set when the transform changes until the renderer computed the new matrices
+	bool dirty;
+	// Incremented when the transform changes, the renderer uploads the matrices to the frames holding an older version
+	uint64_t version;
 
-	std::vector<VkDescriptorSet> descriptorSets;
-	std::vector<VkDescriptorSet> shadowsDescriptorSets;
+	float worldAABBMin[3];
+	float worldAABBMax[3];
+	float worldBoundingSphere[4];
+	// Version of the transform the world bounds have been computed for
+	uint64_t boundsVersion;
 
 	SGNode* node;
 
@@ -41,6 +41,22 @@ void Renderer::setResolution(int newWidth, int newHeight) {
 	height = newHeight;
 }
 
+void Renderer::setIndirectDraw(bool newIndirectDraw) {
+	indirectDraw = newIndirectDraw;
+}
+
+void Renderer::setOcclusionCulling(bool newOcclusionCulling) {
+	occlusionCulling = newOcclusionCulling;
+}
+
+void Renderer::setDepthPrepass(bool newDepthPrepass) {
+	depthPrepass = newDepthPrepass;
+}
+
+void Renderer::setEvictionCallback(EvictionCallback callback, void* userData) {
+	memoryAllocator.setEvictionCallback(callback, userData);
+}
+
 void Renderer::run() {
 	initWindow();
 	initVulkan();
@@ -152,6 +168,7 @@ void Renderer::initWindow() {
 	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	glfwSetCursorPosCallback(window, mouseCallback);
+	glfwSetKeyCallback(window, keyCallback);
 }
 
 void Renderer::initVulkan() {
@@ -166,6 +183,8 @@ void Renderer::initVulkan() {
 	createRenderPass();
 	createDescriptorSetLayout();
 	createGraphicsPipeline();
+	createCullingPipeline();
+	createDepthPyramidPipelines();
 	createCommandPools();
 	createColorResources();
 	createDepthResources();
@@ -318,6 +337,20 @@ void Renderer::createLogicalDevice() {
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 	deviceFeatures.sampleRateShading = VK_TRUE;
 
+	// Multi-draw indirect submits every draw of a batch with one call
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	if (supportedFeatures.multiDrawIndirect) {
+		deviceFeatures.multiDrawIndirect = VK_TRUE;
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		maxDrawIndirectCount = properties.limits.maxDrawIndirectCount;
+	}
+	if (supportedFeatures.depthClamp) {
+		deviceFeatures.depthClamp = VK_TRUE;
+		depthClampSupported = true;
+	}
+
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
@@ -325,8 +358,39 @@ void Renderer::createLogicalDevice() {
 
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	// Draw indirect count (Vulkan 1.2) reads the number of draws kept by the culling pass, it needs multi-draw indirect
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	if (supportedFeatures.multiDrawIndirect && deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+		VkPhysicalDeviceVulkan12Features supportedVulkan12Features = {};
+		supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+		supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures2.pNext = &supportedVulkan12Features;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+		if (supportedVulkan12Features.drawIndirectCount) {
+			vulkan12Features.drawIndirectCount = VK_TRUE;
+			drawIndirectCountSupported = true;
+			createInfo.pNext = &vulkan12Features;
+		}
+	}
+
+	// The occlusion culling builds its depth pyramid from the depth image, which has as many samples as the color image
+	VkFormatProperties depthFormatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, findDepthFormat(), &depthFormatProperties);
+	occlusionCullingSupported = (deviceProperties.limits.sampledImageDepthSampleCounts & msaaSamples) && (depthFormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+
+	// VK_EXT_memory_budget tells the memory allocator how much memory it can use
+	std::vector<const char*> enabledExtensions = deviceExtensions;
+	memoryBudgetSupported = checkOptionalDeviceExtensionSupport(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (memoryBudgetSupported) {
+		enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 	if (enableValidationLayers) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -348,8 +412,21 @@ void Renderer::createMemoryAllocator() {
 	VkPhysicalDeviceMemoryProperties memProperties;
 	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
 
-	memoryAllocator.setDevice(&device);
+	memoryBackend.setDevice(&device);
+	memoryBackend.setPhysicalDevice(&physicalDevice);
+	memoryBackend.setMemoryBudgetSupported(memoryBudgetSupported);
+	memoryAllocator.setBackend(&memoryBackend);
 	memoryAllocator.setPhysicalDeviceMemoryProperties(memProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	memoryAllocator.setPhysicalDeviceLimits(properties.limits);
+
+#ifdef ONIENGINE_MEMORY_TRACE
+	memoryAllocator.startTrace(MEMORY_TRACE_PATH);
+#endif
+
+	memoryAllocator.createRingBuffer(RING_BUFFER_FRAME_SIZE, MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, properties.limits.minUniformBufferOffsetAlignment);
 }
 
 void Renderer::recreateSwapChain() {
@@ -379,13 +456,23 @@ void Renderer::recreateSwapChain() {
 void Renderer::cleanupSwapChain() {
 	vkDestroyImageView(device, colorImageView, nullptr);
 	vkDestroyImage(device, colorImage, nullptr);
+	memoryAllocator.free(colorImageAllocation);
 
 	vkDestroyImageView(device, depthImageView, nullptr);
 	vkDestroyImage(device, depthImage, nullptr);
+	memoryAllocator.free(depthImageAllocation);
+
+	for (VkImageView imageView : depthPyramidLevelViews) {
+		vkDestroyImageView(device, imageView, nullptr);
+	}
+	vkDestroyImageView(device, depthPyramidImageView, nullptr);
+	vkDestroyImage(device, depthPyramidImage, nullptr);
+	memoryAllocator.free(depthPyramidImageAllocation);
 
 	for (int i = 0; i < scene->getDirectionalLights().size() + scene->getSpotLights().size(); i++) {
 		vkDestroyImageView(device, shadowsImageViews[i], nullptr);
 		vkDestroyImage(device, shadowsImages[i], nullptr);
+		memoryAllocator.free(shadowsImageAllocations[i]);
 		for (int j = 0; j < swapChainImages.size(); j++) {
 			vkDestroyFramebuffer(device, shadowsFramebuffers[j][i], nullptr);
 		}
@@ -405,6 +492,7 @@ void Renderer::cleanupSwapChain() {
 	}
 
 	vkDestroyRenderPass(device, renderPass, nullptr);
+	vkDestroyRenderPass(device, occlusionRenderPass, nullptr);
 	vkDestroyRenderPass(device, shadowsRenderPass, nullptr);
 
 	for (VkImageView imageView : swapChainImageViews) {
@@ -412,31 +500,31 @@ void Renderer::cleanupSwapChain() {
 	}
 	vkDestroySwapchainKHR(device, swapChain, nullptr);
 
-	for (Object* obj : scene->getElements()) {
-		for (size_t i = 0; i < swapChainImages.size(); i++) {
-			vkFreeMemory(device, obj->getObjectBufferMemories()->at(i), nullptr);
-			vkDestroyBuffer(device, obj->getObjectBuffers()->at(i), nullptr);
-		}
-	}
+	memoryAllocator.free(objectBufferAllocation);
+	memoryAllocator.free(instanceBufferAllocation);
+	memoryAllocator.free(indirectBufferAllocation);
+	memoryAllocator.free(cullingDrawBufferAllocation);
+	memoryAllocator.free(cullingInstanceBufferAllocation);
+	memoryAllocator.free(cullingCountBufferAllocation);
+	memoryAllocator.free(visibilityBufferAllocation);
 
 	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		vkFreeCommandBuffers(device, renderingCommandPools[i], 1, &renderingCommandBuffers[i]);
-
-		vkFreeMemory(device, skyboxBufferMemories[i], nullptr);
-		vkDestroyBuffer(device, skyboxBuffers[i], nullptr);
-		vkFreeMemory(device, cameraBuffersMemory[i], nullptr);
-		vkDestroyBuffer(device, cameraBuffers[i], nullptr);
-		vkFreeMemory(device, lightsBuffersMemory[i], nullptr);
-		vkDestroyBuffer(device, lightsBuffers[i], nullptr);
-		vkFreeMemory(device, shadowsBuffersMemory[i], nullptr);
-		vkDestroyBuffer(device, shadowsBuffers[i], nullptr);
+		vkFreeCommandBuffers(device, renderingCommandPools[i].commandPool, 1, &renderingCommandBuffers[i]);
+		if (!renderingCommandPools[i].secondaryCommandBuffers.empty()) {
+			vkFreeCommandBuffers(device, renderingCommandPools[i].commandPool, static_cast<uint32_t>(renderingCommandPools[i].secondaryCommandBuffers.size()), renderingCommandPools[i].secondaryCommandBuffers.data());
+			renderingCommandPools[i].secondaryCommandBuffers.clear();
+		}
+		renderingCommandPools[i].usedSecondaryCommandBuffers = 0;
 	}
 
+	// Recorded commands use the destroyed pipelines and descriptor sets
+	invalidateRecordedCommands();
+
 	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 	vkDestroyDescriptorPool(device, skyboxDescriptorPool, nullptr);
 	vkDestroyDescriptorPool(device, shadowsDescriptorPool, nullptr);
-
-	memoryAllocator.free();
+	vkDestroyDescriptorPool(device, cullingDescriptorPool, nullptr);
+	vkDestroyDescriptorPool(device, depthPyramidDescriptorPool, nullptr);
 }
 
 void Renderer::createSwapChain() {
@@ -519,11 +607,12 @@ void Renderer::createRenderPass() {
 	depthAttachment.format = findDepthFormat();
 	depthAttachment.samples = msaaSamples;
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	// The depth pyramid of the occlusion culling is built from the depth after the pass
+	depthAttachment.storeOp = occlusionCullingSupported ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = occlusionCullingSupported ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference depthAttachmentRef = {};
 	depthAttachmentRef.attachment = 1;
@@ -550,15 +639,30 @@ void Renderer::createRenderPass() {
 	subpass.pDepthStencilAttachment = &depthAttachmentRef;
 	subpass.pResolveAttachments = &colorAttachmentResolveRef;
 
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+	std::array<VkSubpassDependency, 3> dependencies = {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].srcAccessMask = 0;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
 		| VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+	// The depth is written once the previous frame is done with it, the depth pyramid pass reads it after the pass
+	dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].dstSubpass = 0;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	dependencies[2].srcSubpass = 0;
+	dependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[2].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[2].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
 	std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -566,13 +670,46 @@ void Renderer::createRenderPass() {
 	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
 
 	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create render pass!");
 	}
 
+	// Occlusion culling, the objects found visible by the second phase are drawn over the first main pass
+	if (occlusionCullingSupported) {
+		VkAttachmentDescription occlusionColorAttachment = colorAttachment;
+		occlusionColorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		occlusionColorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentDescription occlusionDepthAttachment = depthAttachment;
+		occlusionDepthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		occlusionDepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		occlusionDepthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		occlusionDepthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDependency occlusionDependency = {};
+		occlusionDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		occlusionDependency.dstSubpass = 0;
+		occlusionDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		occlusionDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		occlusionDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		occlusionDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+			| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		// Same attachments as the main render pass so the pipelines and framebuffers are compatible
+		std::array<VkAttachmentDescription, 3> occlusionAttachments = { occlusionColorAttachment, occlusionDepthAttachment, colorAttachmentResolve };
+		VkRenderPassCreateInfo occlusionRenderPassInfo = renderPassInfo;
+		occlusionRenderPassInfo.pAttachments = occlusionAttachments.data();
+		occlusionRenderPassInfo.dependencyCount = 1;
+		occlusionRenderPassInfo.pDependencies = &occlusionDependency;
+
+		if (vkCreateRenderPass(device, &occlusionRenderPassInfo, nullptr, &occlusionRenderPass) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create occlusion render pass!");
+		}
+	}
+
 	// Shadows
 
 	VkAttachmentDescription shadowsDepthAttachment = {};
@@ -628,28 +765,28 @@ void Renderer::createRenderPass() {
 void Renderer::createDescriptorSetLayout() {
 	VkDescriptorSetLayoutBinding oboLayoutBinding = {};
 	oboLayoutBinding.binding = 0;
-	oboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	oboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 	oboLayoutBinding.descriptorCount = 1;
 	oboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	oboLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding cboLayoutBinding = {};
 	cboLayoutBinding.binding = 1;
-	cboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	cboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	cboLayoutBinding.descriptorCount = 1;
 	cboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	cboLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding lboLayoutBinding = {};
 	lboLayoutBinding.binding = 2;
-	lboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	lboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	lboLayoutBinding.descriptorCount = 1;
 	lboLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	lboLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding sboLayoutBinding = {};
 	sboLayoutBinding.binding = 3;
-	sboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	sboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	sboLayoutBinding.descriptorCount = 1;
 	sboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	sboLayoutBinding.pImmutableSamplers = nullptr;
@@ -661,56 +798,75 @@ void Renderer::createDescriptorSetLayout() {
 	shadowsSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	shadowsSamplerLayoutBinding.pImmutableSamplers = nullptr;
 
+	VkDescriptorSetLayoutBinding iboLayoutBinding = {};
+	iboLayoutBinding.binding = 5;
+	iboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	iboLayoutBinding.descriptorCount = 1;
+	iboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	iboLayoutBinding.pImmutableSamplers = nullptr;
+
+	std::array<VkDescriptorSetLayoutBinding, 6> bindings = { oboLayoutBinding, cboLayoutBinding, lboLayoutBinding, sboLayoutBinding, shadowsSamplerLayoutBinding, iboLayoutBinding };
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create descriptor set layout!");
+	}
+
+	// Material
 	VkDescriptorSetLayoutBinding diffuseSamplerLayoutBinding = {};
-	diffuseSamplerLayoutBinding.binding = 5;
+	diffuseSamplerLayoutBinding.binding = 0;
 	diffuseSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	diffuseSamplerLayoutBinding.descriptorCount = 1;
 	diffuseSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	diffuseSamplerLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding normalSamplerLayoutBinding = {};
-	normalSamplerLayoutBinding.binding = 6;
+	normalSamplerLayoutBinding.binding = 1;
 	normalSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	normalSamplerLayoutBinding.descriptorCount = 1;
 	normalSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	normalSamplerLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding metallicSamplerLayoutBinding = {};
-	metallicSamplerLayoutBinding.binding = 7;
+	metallicSamplerLayoutBinding.binding = 2;
 	metallicSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	metallicSamplerLayoutBinding.descriptorCount = 1;
 	metallicSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	metallicSamplerLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding roughnessSamplerLayoutBinding = {};
-	roughnessSamplerLayoutBinding.binding = 8;
+	roughnessSamplerLayoutBinding.binding = 3;
 	roughnessSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	roughnessSamplerLayoutBinding.descriptorCount = 1;
 	roughnessSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	roughnessSamplerLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding AOSamplerLayoutBinding = {};
-	AOSamplerLayoutBinding.binding = 9;
+	AOSamplerLayoutBinding.binding = 4;
 	AOSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	AOSamplerLayoutBinding.descriptorCount = 1;
 	AOSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	AOSamplerLayoutBinding.pImmutableSamplers = nullptr;
 
-	std::array<VkDescriptorSetLayoutBinding, 10> bindings = { oboLayoutBinding, cboLayoutBinding, lboLayoutBinding, sboLayoutBinding, shadowsSamplerLayoutBinding, diffuseSamplerLayoutBinding, normalSamplerLayoutBinding, metallicSamplerLayoutBinding, roughnessSamplerLayoutBinding, AOSamplerLayoutBinding };
+	std::array<VkDescriptorSetLayoutBinding, 5> materialBindings = { diffuseSamplerLayoutBinding, normalSamplerLayoutBinding, metallicSamplerLayoutBinding, roughnessSamplerLayoutBinding, AOSamplerLayoutBinding };
 
-	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-	layoutInfo.pBindings = bindings.data();
+	VkDescriptorSetLayoutCreateInfo materialLayoutInfo = {};
+	materialLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	materialLayoutInfo.bindingCount = static_cast<uint32_t>(materialBindings.size());
+	materialLayoutInfo.pBindings = materialBindings.data();
 
-	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create descriptor set layout!");
+	if (vkCreateDescriptorSetLayout(device, &materialLayoutInfo, nullptr, &materialDescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create material descriptor set layout!");
 	}
 
 	// Skybox
 	VkDescriptorSetLayoutBinding skyboxCboLayoutBinding = {};
 	skyboxCboLayoutBinding.binding = 0;
-	skyboxCboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	skyboxCboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	skyboxCboLayoutBinding.descriptorCount = 1;
 	skyboxCboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	skyboxCboLayoutBinding.pImmutableSamplers = nullptr;
@@ -736,19 +892,26 @@ void Renderer::createDescriptorSetLayout() {
 	// Shadows
 	VkDescriptorSetLayoutBinding shadowsOboLayoutBinding = {};
 	shadowsOboLayoutBinding.binding = 0;
-	shadowsOboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	shadowsOboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 	shadowsOboLayoutBinding.descriptorCount = 1;
 	shadowsOboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	shadowsOboLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding shadowsSboLayoutBinding = {};
 	shadowsSboLayoutBinding.binding = 1;
-	shadowsSboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	shadowsSboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	shadowsSboLayoutBinding.descriptorCount = 1;
 	shadowsSboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	shadowsSboLayoutBinding.pImmutableSamplers = nullptr;
 
-	std::array<VkDescriptorSetLayoutBinding, 2> shadowsBindings = { shadowsOboLayoutBinding, shadowsSboLayoutBinding };
+	VkDescriptorSetLayoutBinding shadowsIboLayoutBinding = {};
+	shadowsIboLayoutBinding.binding = 2;
+	shadowsIboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	shadowsIboLayoutBinding.descriptorCount = 1;
+	shadowsIboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	shadowsIboLayoutBinding.pImmutableSamplers = nullptr;
+
+	std::array<VkDescriptorSetLayoutBinding, 3> shadowsBindings = { shadowsOboLayoutBinding, shadowsSboLayoutBinding, shadowsIboLayoutBinding };
 
 	VkDescriptorSetLayoutCreateInfo shadowsLayoutInfo = {};
 	shadowsLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -758,10 +921,118 @@ void Renderer::createDescriptorSetLayout() {
 	if (vkCreateDescriptorSetLayout(device, &shadowsLayoutInfo, nullptr, &shadowsDescriptorSetLayout) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create shadows descriptor set layout!");
 	}
+
+	// Culling, the buffers are a frame in flight's regions except the frustums in the ring buffer
+	VkDescriptorSetLayoutBinding cullingOboLayoutBinding = {};
+	cullingOboLayoutBinding.binding = 0;
+	cullingOboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullingOboLayoutBinding.descriptorCount = 1;
+	cullingOboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullingOboLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding cullingCboLayoutBinding = {};
+	cullingCboLayoutBinding.binding = 1;
+	cullingCboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	cullingCboLayoutBinding.descriptorCount = 1;
+	cullingCboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullingCboLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding cullingDrawsLayoutBinding = {};
+	cullingDrawsLayoutBinding.binding = 2;
+	cullingDrawsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullingDrawsLayoutBinding.descriptorCount = 1;
+	cullingDrawsLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullingDrawsLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding cullingInstancesLayoutBinding = {};
+	cullingInstancesLayoutBinding.binding = 3;
+	cullingInstancesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullingInstancesLayoutBinding.descriptorCount = 1;
+	cullingInstancesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullingInstancesLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding cullingIboLayoutBinding = {};
+	cullingIboLayoutBinding.binding = 4;
+	cullingIboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullingIboLayoutBinding.descriptorCount = 1;
+	cullingIboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullingIboLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding cullingCommandsLayoutBinding = {};
+	cullingCommandsLayoutBinding.binding = 5;
+	cullingCommandsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullingCommandsLayoutBinding.descriptorCount = 1;
+	cullingCommandsLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullingCommandsLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding cullingCountsLayoutBinding = {};
+	cullingCountsLayoutBinding.binding = 6;
+	cullingCountsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullingCountsLayoutBinding.descriptorCount = 1;
+	cullingCountsLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullingCountsLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding cullingDepthPyramidLayoutBinding = {};
+	cullingDepthPyramidLayoutBinding.binding = 7;
+	cullingDepthPyramidLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	cullingDepthPyramidLayoutBinding.descriptorCount = 1;
+	cullingDepthPyramidLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullingDepthPyramidLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding cullingVisibilityLayoutBinding = {};
+	cullingVisibilityLayoutBinding.binding = 8;
+	cullingVisibilityLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullingVisibilityLayoutBinding.descriptorCount = 1;
+	cullingVisibilityLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullingVisibilityLayoutBinding.pImmutableSamplers = nullptr;
+
+	std::array<VkDescriptorSetLayoutBinding, 9> cullingBindings = { cullingOboLayoutBinding, cullingCboLayoutBinding, cullingDrawsLayoutBinding, cullingInstancesLayoutBinding, cullingIboLayoutBinding, cullingCommandsLayoutBinding, cullingCountsLayoutBinding, cullingDepthPyramidLayoutBinding, cullingVisibilityLayoutBinding };
+
+	VkDescriptorSetLayoutCreateInfo cullingLayoutInfo = {};
+	cullingLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	cullingLayoutInfo.bindingCount = static_cast<uint32_t>(cullingBindings.size());
+	cullingLayoutInfo.pBindings = cullingBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &cullingLayoutInfo, nullptr, &cullingDescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create culling descriptor set layout!");
+	}
+
+	// Depth pyramid, the depth image then the level read and the level written
+	VkDescriptorSetLayoutBinding depthPyramidDepthLayoutBinding = {};
+	depthPyramidDepthLayoutBinding.binding = 0;
+	depthPyramidDepthLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	depthPyramidDepthLayoutBinding.descriptorCount = 1;
+	depthPyramidDepthLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	depthPyramidDepthLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding depthPyramidSrcLayoutBinding = {};
+	depthPyramidSrcLayoutBinding.binding = 1;
+	depthPyramidSrcLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	depthPyramidSrcLayoutBinding.descriptorCount = 1;
+	depthPyramidSrcLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	depthPyramidSrcLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding depthPyramidDstLayoutBinding = {};
+	depthPyramidDstLayoutBinding.binding = 2;
+	depthPyramidDstLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	depthPyramidDstLayoutBinding.descriptorCount = 1;
+	depthPyramidDstLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	depthPyramidDstLayoutBinding.pImmutableSamplers = nullptr;
+
+	std::array<VkDescriptorSetLayoutBinding, 3> depthPyramidBindings = { depthPyramidDepthLayoutBinding, depthPyramidSrcLayoutBinding, depthPyramidDstLayoutBinding };
+
+	VkDescriptorSetLayoutCreateInfo depthPyramidLayoutInfo = {};
+	depthPyramidLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	depthPyramidLayoutInfo.bindingCount = static_cast<uint32_t>(depthPyramidBindings.size());
+	depthPyramidLayoutInfo.pBindings = depthPyramidBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &depthPyramidLayoutInfo, nullptr, &depthPyramidDescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth pyramid descriptor set layout!");
+	}
 }
 
 void Renderer::createGraphicsPipeline() {
-	int pipelinesSize = 3;
+	int pipelinesSize = 5;
 	graphicsPipelines.resize(pipelinesSize);
 	graphicsPipelineLayouts.resize(pipelinesSize);
 
@@ -781,9 +1052,18 @@ void Renderer::createGraphicsPipeline() {
 
 	createPBRGraphicsPipeline();
 
+	pbrGraphicsPipelineIndex = 2;
+	pbrDepthEqualGraphicsPipelineIndex = 3;
+
 	for (Object* obj : scene->getElements()) {
-		obj->setGraphicsPipelineIndex(2);
+		obj->setGraphicsPipelineIndex(pbrGraphicsPipelineIndex);
 	}
+
+	// Depth pre-pass pipeline
+
+	createDepthPrepassGraphicsPipeline();
+
+	depthPrepassGraphicsPipelineIndex = 4;
 }
 
 void Renderer::createFramebuffers() {
@@ -832,6 +1112,9 @@ void Renderer::createFramebuffers() {
 void Renderer::createCommandPools() {
 	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
 
+	// Command pools are externally synchronized, each recording thread has its own
+	recordingThreads.start(std::min(std::max(std::thread::hardware_concurrency(), 1u), MAX_RECORDING_THREADS));
+
 	renderingCommandPools.resize(swapChainImages.size());
 	VkCommandPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -839,9 +1122,25 @@ void Renderer::createCommandPools() {
 	poolInfo.flags = 0;
 
 	for (int i = 0; i < swapChainImages.size(); i++) {
-		if (vkCreateCommandPool(device, &poolInfo, nullptr, &renderingCommandPools[i]) != VK_SUCCESS) {
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &renderingCommandPools[i].commandPool) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create rendering command pool!");
 		}
+		renderingCommandPools[i].usedSecondaryCommandBuffers = 0;
+	}
+
+	for (RecordedCommands& frameCommands : recordedCommands) {
+		frameCommands.commandPools.resize(recordingThreads.getThreadCount());
+		for (RecordingCommandPool& recordingCommandPool : frameCommands.commandPools) {
+			if (vkCreateCommandPool(device, &poolInfo, nullptr, &recordingCommandPool.commandPool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create recording command pool!");
+			}
+			recordingCommandPool.usedSecondaryCommandBuffers = 0;
+		}
+		frameCommands.shadowsPassCount = 0;
+		frameCommands.objectsSliceCount = 0;
+		frameCommands.occlusionSliceCount = 0;
+		frameCommands.drawStateHash = 0;
+		frameCommands.valid = false;
 	}
 
 	if (vkCreateCommandPool(device, &poolInfo, nullptr, &singleTimeCommandPool) != VK_SUCCESS) {
@@ -852,7 +1151,7 @@ void Renderer::createCommandPools() {
 void Renderer::createColorResources() {
 	VkFormat colorFormat = swapChainImageFormat;
 
-	createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage);
+	createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageAllocation, false);
 
 	colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 	transitionImageLayout(colorImage, colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1, 1);
@@ -861,28 +1160,68 @@ void Renderer::createColorResources() {
 void Renderer::createDepthResources() {
 	VkFormat depthFormat = findDepthFormat();
 
-	createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage);
+	// Sampled by the depth pyramid pass
+	VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (occlusionCullingSupported) {
+		depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
+	createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, depthUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageAllocation, false);
 
 	depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 	transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1, 1);
 
+	createDepthPyramidResources();
+
 	// Shadows
 
 	shadowsImages.resize(scene->getDirectionalLights().size() + scene->getSpotLights().size());
+	shadowsImageAllocations.resize(scene->getDirectionalLights().size() + scene->getSpotLights().size());
 	shadowsImageViews.resize(scene->getDirectionalLights().size() + scene->getSpotLights().size());
 	for (int i = 0; i < scene->getDirectionalLights().size() + scene->getSpotLights().size(); i++) {
-		createImage(SHADOWMAP_WIDTH, SHADOWMAP_HEIGHT, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_D16_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shadowsImages[i]);
+		createImage(SHADOWMAP_WIDTH, SHADOWMAP_HEIGHT, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_D16_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shadowsImages[i], shadowsImageAllocations[i], false);
 
 		shadowsImageViews[i] = createImageView(shadowsImages[i], VK_FORMAT_D16_UNORM, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 	}
 }
 
+void Renderer::createDepthPyramidResources() {
+	// Created even without occlusion culling as the culling pass always binds it
+	depthPyramidWidth = swapChainExtent.width;
+	depthPyramidHeight = swapChainExtent.height;
+	depthPyramidLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(depthPyramidWidth, depthPyramidHeight)))) + 1;
+
+	createImage(depthPyramidWidth, depthPyramidHeight, depthPyramidLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthPyramidImage, depthPyramidImageAllocation, false);
+
+	// The culling pass reads every level, the depth pyramid pass writes them one by one
+	depthPyramidImageView = createImageView(depthPyramidImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, depthPyramidLevels);
+	depthPyramidLevelViews.resize(depthPyramidLevels);
+	for (uint32_t i = 0; i < depthPyramidLevels; i++) {
+		VkImageViewCreateInfo viewInfo = {};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = depthPyramidImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = i;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(device, &viewInfo, nullptr, &depthPyramidLevelViews[i]) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create depth pyramid level image view!");
+		}
+	}
+	transitionImageLayout(depthPyramidImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, depthPyramidLevels, 1);
+}
+
 void Renderer::createTextures() {
 	// Create textures for all elements
 	for (Object* obj : scene->getElements()) {
 		Material* mat = obj->getMaterial();
 		if (!mat->isConstructed()) {
 			mat->constructedTrue();
+			mat->setIndex(static_cast<uint32_t>(materials.size()));
+			materials.push_back(mat);
 			createTextureImage(mat);
 			createTextureImageView(mat);
 			createTextureSampler(mat);
@@ -912,6 +1251,24 @@ void Renderer::createTextures() {
 	if (vkCreateSampler(device, &shadowsSamplerInfo, nullptr, &shadowsSampler) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create shadow texture sampler!");
 	}
+
+	// Depth pyramid sampler, the depth image and the depth pyramid are only read with texelFetch
+	VkSamplerCreateInfo depthPyramidSamplerInfo = {};
+	depthPyramidSamplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	depthPyramidSamplerInfo.magFilter = VK_FILTER_NEAREST;
+	depthPyramidSamplerInfo.minFilter = VK_FILTER_NEAREST;
+	depthPyramidSamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	depthPyramidSamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	depthPyramidSamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	depthPyramidSamplerInfo.maxAnisotropy = 1.0f;
+	depthPyramidSamplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	depthPyramidSamplerInfo.minLod = 0.0f;
+	depthPyramidSamplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	depthPyramidSamplerInfo.mipLodBias = 0.0f;
+
+	if (vkCreateSampler(device, &depthPyramidSamplerInfo, nullptr, &depthPyramidSampler) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth pyramid sampler!");
+	}
 }
 
 void Renderer::createModels() {
@@ -919,10 +1276,12 @@ void Renderer::createModels() {
 	loadSkyboxModel();
 
 	// Create models for all elements
+	uint32_t modelIndex = 0;
 	for (Object* obj : scene->getElements()) {
 		Model* model = obj->getModel();
 		if (!model->isConstructed()) {
 			model->constructedTrue();
+			model->setIndex(modelIndex++);
 			if (model->getModelPath() != "") {
 				loadModelFromFile(model);
 			}
@@ -936,66 +1295,89 @@ void Renderer::createModels() {
 }
 
 void Renderer::createUniformBuffers() {
-	VkDeviceSize bufferSize = sizeof(ObjectBufferObject);
-	for (Object* obj : scene->getElements()) {
-		obj->getObjectBuffers()->resize(swapChainImages.size());
-		obj->getObjectBufferMemories()->resize(swapChainImages.size());
-		for (size_t i = 0; i < swapChainImages.size(); i++) {
-			createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-				| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, obj->getObjectBuffers()->at(i), obj->getObjectBufferMemories()->at(i));
-		}
-	}
-
-	// Skybox
-
-	skyboxBuffers.resize(swapChainImages.size());
-	skyboxBufferMemories.resize(swapChainImages.size());
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-			| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, skyboxBuffers[i], skyboxBufferMemories[i]);
-	}
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
 
-	// Camera
-	cameraBuffers.resize(swapChainImages.size());
-	cameraBuffersMemory.resize(swapChainImages.size());
+	// Objects are packed in each frame in flight's region, dynamic offsets must be multiples of minStorageBufferOffsetAlignment
+	objectBufferFrameSize = sizeof(ObjectBufferObject) * std::max(scene->nbElements(), 1);
+	objectBufferFrameSize = (objectBufferFrameSize + alignment - 1) & ~(alignment - 1);
+	createBuffer(objectBufferFrameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, objectBufferAllocation);
 
-	bufferSize = sizeof(CameraBufferObject);
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cameraBuffers[i], cameraBuffersMemory[i]);
+	uint32_t objectBufferIndex = 0;
+	for (Object* obj : scene->getElements()) {
+		obj->setObjectBufferIndex(objectBufferIndex++);
 	}
 
-	// Lights
-	lightsBuffers.resize(swapChainImages.size());
-	lightsBuffersMemory.resize(swapChainImages.size());
-
-	bufferSize = sizeof(LightsBufferObject);
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, lightsBuffers[i], lightsBuffersMemory[i]);
-	}
+	// The new buffer holds no object, versions start at 1
+	objectBufferData.resize(scene->getElements().size());
+	objectBufferVersions.assign(MAX_FRAMES_IN_FLIGHT, std::vector<uint64_t>(scene->getElements().size(), 0));
 
-	// Shadows
-	shadowsBuffers.resize(swapChainImages.size());
-	shadowsBuffersMemory.resize(swapChainImages.size());
+	// Objects' bounding spheres are culled in object buffer order
+	frustumCuller.resize(scene->getElements().size());
+	objectVisibility.assign(scene->getElements().size(), 1);
+	viewDrawGroups.resize(1 + scene->getDirectionalLights().size() + scene->getSpotLights().size());
 
-	bufferSize = sizeof(ShadowsBufferObject);
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, shadowsBuffers[i], shadowsBuffersMemory[i]);
-	}
+	// At most one indirect command per mesh of each object, when no object shares its group, and as many instances
+	size_t maxDraws = std::max(scene->nbElements(), 1);
+	for (Object* obj : scene->getElements()) {
+		maxDraws += obj->getModel()->getMeshes().size();
+	}
+	cullingViewCount = static_cast<uint32_t>(1 + scene->getDirectionalLights().size() + scene->getSpotLights().size());
+	// The second phase of the occlusion culling writes the camera's draws in one more view
+	size_t viewCount = cullingViewCount + 1;
+
+	// Objects' indices in draw list order, the instance index of a draw gives the object
+	// The culling pass writes the visible instances of each draw for each view
+	instanceBufferFrameSize = sizeof(uint32_t) * viewCount * maxDraws;
+	instanceBufferFrameSize = (instanceBufferFrameSize + alignment - 1) & ~(alignment - 1);
+	createBuffer(instanceBufferFrameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instanceBufferAllocation);
+
+	// Draw commands of each view, written by the culling pass
+	indirectBufferFrameSize = sizeof(VkDrawIndexedIndirectCommand) * viewCount * maxDraws;
+	indirectBufferFrameSize = (indirectBufferFrameSize + alignment - 1) & ~(alignment - 1);
+	createBuffer(indirectBufferFrameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirectBufferAllocation);
+
+	// Culling pass inputs
+	cullingDrawBufferFrameSize = sizeof(CullingDraw) * maxDraws;
+	cullingDrawBufferFrameSize = (cullingDrawBufferFrameSize + alignment - 1) & ~(alignment - 1);
+	createBuffer(cullingDrawBufferFrameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cullingDrawBufferAllocation);
+	cullingInstanceBufferFrameSize = sizeof(CullingInstance) * maxDraws;
+	cullingInstanceBufferFrameSize = (cullingInstanceBufferFrameSize + alignment - 1) & ~(alignment - 1);
+	createBuffer(cullingInstanceBufferFrameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cullingInstanceBufferAllocation);
+
+	// Draw count of each batch and instance count of each draw, for each view
+	cullingCountBufferFrameSize = sizeof(uint32_t) * 2 * viewCount * maxDraws;
+	cullingCountBufferFrameSize = (cullingCountBufferFrameSize + alignment - 1) & ~(alignment - 1);
+	createBuffer(cullingCountBufferFrameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cullingCountBufferAllocation);
+
+	// Camera visibility of each object for the previous and the current frames, shared by the frames in flight as they are culled in order
+	// Its content does not need to be initialized, a wrong visibility only draws an object in the other phase
+	visibilityBufferSize = sizeof(uint32_t) * 2 * std::max(scene->nbElements(), 1);
+	createBuffer(visibilityBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibilityBufferAllocation);
+
+	// Camera, lights and shadows are in the ring buffer
 }
 
 void Renderer::createDescriptorPool() {
-	int nbElems = scene->nbElements();
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(nbElems * swapChainImages.size() * 4);
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(nbElems * swapChainImages.size() * 6);
-
+	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = 2 * MAX_FRAMES_IN_FLIGHT;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = 3 * MAX_FRAMES_IN_FLIGHT;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[2].descriptorCount = static_cast<uint32_t>((scene->getDirectionalLights().size() + scene->getSpotLights().size() + materials.size() * 5) * MAX_FRAMES_IN_FLIGHT);
+
+	// One set for the buffers and shadow maps, selected with dynamic offsets, and one set per material, for each frame in flight
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(nbElems * swapChainImages.size());
+	poolInfo.maxSets = static_cast<uint32_t>((1 + materials.size()) * MAX_FRAMES_IN_FLIGHT);
 
 	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create descriptor pool!");
@@ -1003,7 +1385,7 @@ void Renderer::createDescriptorPool() {
 
 	// Skybox
 	std::array<VkDescriptorPoolSize, 2> skyboxPoolSizes = {};
-	skyboxPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	skyboxPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	skyboxPoolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
 	skyboxPoolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	skyboxPoolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
@@ -1019,36 +1401,98 @@ void Renderer::createDescriptorPool() {
 	}
 
 	// Shadows
-	VkDescriptorPoolSize shadowsPoolSize = {};
-	shadowsPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	shadowsPoolSize.descriptorCount = static_cast<uint32_t>(nbElems * swapChainImages.size() * 2);
+	std::array<VkDescriptorPoolSize, 2> shadowsPoolSizes = {};
+	shadowsPoolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	shadowsPoolSizes[0].descriptorCount = 2 * MAX_FRAMES_IN_FLIGHT;
+	shadowsPoolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	shadowsPoolSizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
 
 	VkDescriptorPoolCreateInfo shadowsPoolInfo = {};
 	shadowsPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	shadowsPoolInfo.poolSizeCount = 1;
-	shadowsPoolInfo.pPoolSizes = &shadowsPoolSize;
-	shadowsPoolInfo.maxSets = static_cast<uint32_t>(nbElems * swapChainImages.size());
+	shadowsPoolInfo.poolSizeCount = static_cast<uint32_t>(shadowsPoolSizes.size());
+	shadowsPoolInfo.pPoolSizes = shadowsPoolSizes.data();
+	shadowsPoolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
 
 	if (vkCreateDescriptorPool(device, &shadowsPoolInfo, nullptr, &shadowsDescriptorPool) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create shadows descriptor pool!");
 	}
+
+	// Culling, one set per frame in flight
+	std::array<VkDescriptorPoolSize, 3> cullingPoolSizes = {};
+	cullingPoolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullingPoolSizes[0].descriptorCount = 7 * MAX_FRAMES_IN_FLIGHT;
+	cullingPoolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	cullingPoolSizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+	cullingPoolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	cullingPoolSizes[2].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+
+	VkDescriptorPoolCreateInfo cullingPoolInfo = {};
+	cullingPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	cullingPoolInfo.poolSizeCount = static_cast<uint32_t>(cullingPoolSizes.size());
+	cullingPoolInfo.pPoolSizes = cullingPoolSizes.data();
+	cullingPoolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+
+	if (vkCreateDescriptorPool(device, &cullingPoolInfo, nullptr, &cullingDescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create culling descriptor pool!");
+	}
+
+	// Depth pyramid, one set per level
+	if (occlusionCullingSupported) {
+		std::array<VkDescriptorPoolSize, 2> depthPyramidPoolSizes = {};
+		depthPyramidPoolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		depthPyramidPoolSizes[0].descriptorCount = depthPyramidLevels;
+		depthPyramidPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		depthPyramidPoolSizes[1].descriptorCount = 2 * depthPyramidLevels;
+
+		VkDescriptorPoolCreateInfo depthPyramidPoolInfo = {};
+		depthPyramidPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		depthPyramidPoolInfo.poolSizeCount = static_cast<uint32_t>(depthPyramidPoolSizes.size());
+		depthPyramidPoolInfo.pPoolSizes = depthPyramidPoolSizes.data();
+		depthPyramidPoolInfo.maxSets = depthPyramidLevels;
+
+		if (vkCreateDescriptorPool(device, &depthPyramidPoolInfo, nullptr, &depthPyramidDescriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create depth pyramid descriptor pool!");
+		}
+	}
 }
 
 void Renderer::createDescriptorSets() {
-	std::vector<VkDescriptorSetLayout> layouts(swapChainImages.size(), descriptorSetLayout);
+	// Every set is written here so the resources moved by the defragmentation do not need to be updated anymore
+	for (MovedResources& frameMovedResources : movedResources) {
+		frameMovedResources = MovedResources();
+	}
+
+	std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
+	layouts.fill(descriptorSetLayout);
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
+	allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
 	allocInfo.pSetLayouts = layouts.data();
 
-	for (Object* obj : scene->getElements()) {
-		obj->getDescriptorSets()->resize(swapChainImages.size());
-		if (vkAllocateDescriptorSets(device, &allocInfo, obj->getDescriptorSets()->data()) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to allocate descriptor sets!");
+	if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate descriptor sets!");
+	}
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		updateDescriptorSets(i);
+	}
+
+	// Materials
+	std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> materialLayouts;
+	materialLayouts.fill(materialDescriptorSetLayout);
+	VkDescriptorSetAllocateInfo materialAllocInfo = {};
+	materialAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	materialAllocInfo.descriptorPool = descriptorPool;
+	materialAllocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+	materialAllocInfo.pSetLayouts = materialLayouts.data();
+
+	for (Material* mat : materials) {
+		mat->getDescriptorSets()->resize(MAX_FRAMES_IN_FLIGHT);
+		if (vkAllocateDescriptorSets(device, &materialAllocInfo, mat->getDescriptorSets()->data()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate material descriptor sets!");
 		}
-		for (size_t i = 0; i < swapChainImages.size(); i++) {
-			updateDescriptorSets(obj, (int)i);
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			updateMaterialDescriptorSets(mat, i);
 		}
 	}
 
@@ -1069,21 +1513,51 @@ void Renderer::createDescriptorSets() {
 	}
 
 	// Shadows
-	std::vector<VkDescriptorSetLayout> shadowsLayouts(swapChainImages.size(), shadowsDescriptorSetLayout);
+	std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> shadowsLayouts;
+	shadowsLayouts.fill(shadowsDescriptorSetLayout);
 	VkDescriptorSetAllocateInfo shadowsAllocInfo = {};
 	shadowsAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	shadowsAllocInfo.descriptorPool = shadowsDescriptorPool;
-	shadowsAllocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
+	shadowsAllocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
 	shadowsAllocInfo.pSetLayouts = shadowsLayouts.data();
 
-	for (Object* obj : scene->getElements()) {
-		obj->getShadowsDescriptorSets()->resize(swapChainImages.size());
-		if (vkAllocateDescriptorSets(device, &shadowsAllocInfo, obj->getShadowsDescriptorSets()->data()) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to allocate shadows descriptor sets!");
-		}
-		for (size_t i = 0; i < swapChainImages.size(); i++) {
-			updateShadowsDescriptorSets(obj, (int)i);
+	if (vkAllocateDescriptorSets(device, &shadowsAllocInfo, shadowsDescriptorSets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate shadows descriptor sets!");
+	}
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		updateShadowsDescriptorSets(i);
+	}
+
+	// Culling
+	std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> cullingLayouts;
+	cullingLayouts.fill(cullingDescriptorSetLayout);
+	VkDescriptorSetAllocateInfo cullingAllocInfo = {};
+	cullingAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	cullingAllocInfo.descriptorPool = cullingDescriptorPool;
+	cullingAllocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+	cullingAllocInfo.pSetLayouts = cullingLayouts.data();
+
+	if (vkAllocateDescriptorSets(device, &cullingAllocInfo, cullingDescriptorSets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate culling descriptor sets!");
+	}
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		updateCullingDescriptorSets(i);
+	}
+
+	// Depth pyramid
+	if (occlusionCullingSupported) {
+		std::vector<VkDescriptorSetLayout> depthPyramidLayouts(depthPyramidLevels, depthPyramidDescriptorSetLayout);
+		VkDescriptorSetAllocateInfo depthPyramidAllocInfo = {};
+		depthPyramidAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		depthPyramidAllocInfo.descriptorPool = depthPyramidDescriptorPool;
+		depthPyramidAllocInfo.descriptorSetCount = depthPyramidLevels;
+		depthPyramidAllocInfo.pSetLayouts = depthPyramidLayouts.data();
+
+		depthPyramidDescriptorSets.resize(depthPyramidLevels);
+		if (vkAllocateDescriptorSets(device, &depthPyramidAllocInfo, depthPyramidDescriptorSets.data()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate depth pyramid descriptor sets!");
 		}
+		updateDepthPyramidDescriptorSets();
 	}
 }
 
@@ -1095,7 +1569,7 @@ void Renderer::createRenderingCommandBuffers() {
 	allocInfo.commandBufferCount = 1;
 
 	for (int i = 0; i < swapChainImages.size(); i++) {
-		allocInfo.commandPool = renderingCommandPools[i];
+		allocInfo.commandPool = renderingCommandPools[i].commandPool;
 		if (vkAllocateCommandBuffers(device, &allocInfo, &renderingCommandBuffers[i]) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to allocate rendering command buffer!");
 		}
@@ -1129,7 +1603,9 @@ void Renderer::createSyncObjects() {
 }
 
 void Renderer::recordRenderingCommandBuffer(uint32_t imageIndex) {
-	vkResetCommandPool(device, renderingCommandPools[imageIndex], 0);
+	// The primary command buffer is recorded every frame, the draws are in secondary command buffers recorded only when they change
+	vkResetCommandPool(device, renderingCommandPools[imageIndex].commandPool, 0);
+	renderingCommandPools[imageIndex].usedSecondaryCommandBuffers = 0;
 
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1140,6 +1616,37 @@ void Renderer::recordRenderingCommandBuffer(uint32_t imageIndex) {
 		throw std::runtime_error("Failed to begin recording command buffer!");
 	}
 
+	// Moved resources must be updated before they are used by the passes
+	defragmentMemory(renderingCommandBuffers[imageIndex]);
+
+	// The culling pass writes the indirect draws of every pass
+	bool occlusion = isOcclusionCullingActive();
+	if (indirectDraw) {
+		recordCullingPass(renderingCommandBuffers[imageIndex]);
+	}
+
+	// Per frame data is read from buffers so the frame's secondary command buffers are kept as long as the draws are the same
+	RecordedCommands& frameCommands = recordedCommands[currentFrame];
+	uint64_t drawStateHash = getDrawStateHash();
+	if (!frameCommands.valid || frameCommands.drawStateHash != drawStateHash) {
+		recordSecondaryCommandBuffers(frameCommands);
+		frameCommands.drawStateHash = drawStateHash;
+		frameCommands.valid = true;
+	}
+
+	// Skybox's descriptor set is per swapchain image, it is drawn last
+	VkCommandBuffer skyboxCommandBuffer = beginSecondaryCommandBuffer(renderingCommandPools[imageIndex], occlusion ? occlusionRenderPass : renderPass, swapChainFramebuffers[imageIndex], VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	vkCmdBindPipeline(skyboxCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[skyboxGraphicsPipelineIndex]);
+	vkCmdBindDescriptorSets(skyboxCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayouts[skyboxGraphicsPipelineIndex], 0, 1, &skyboxDescriptorSets[imageIndex], 1, &cameraBufferOffset);
+	VkBuffer vertexCmdBuffers[] = { vertexBufferAllocation->buffer };
+	VkDeviceSize offset[] = { vertexBufferAllocation->offset };
+	vkCmdBindVertexBuffers(skyboxCommandBuffer, 0, 1, vertexCmdBuffers, offset);
+	vkCmdBindIndexBuffer(skyboxCommandBuffer, indexBufferAllocation->buffer, indexBufferAllocation->offset, VK_INDEX_TYPE_UINT32);
+	vkCmdDrawIndexed(skyboxCommandBuffer, static_cast<uint32_t>(skyboxIndexSize), 1, 0, (int32_t)skyboxIndexOffset, (uint32_t)skyboxVertexOffset);
+	if (vkEndCommandBuffer(skyboxCommandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record secondary command buffer!");
+	}
+
 	std::array<VkClearValue, 2> clearValues = {};
 	clearValues[0].color = { 0.f, 0.f, 0.f, 1.0f };
 	clearValues[1].depthStencil = { 1.0f, 0 };
@@ -1162,53 +1669,280 @@ void Renderer::recordRenderingCommandBuffer(uint32_t imageIndex) {
 	shadowsRenderPassInfo.clearValueCount = 1;
 	shadowsRenderPassInfo.pClearValues = &clearValues[1];
 
-	VkBuffer vertexCmdBuffers[] = { vertexBuffer };
-	VkDeviceSize offset[] = { 0 };
-
 	// First passes : Shadows
-	for (int j = 0; j < scene->getDirectionalLights().size() + scene->getSpotLights().size(); j++) {
+	for (uint32_t j = 0; j < frameCommands.shadowsPassCount; j++) {
 		shadowsRenderPassInfo.framebuffer = shadowsFramebuffers[imageIndex][j];
-		vkCmdBeginRenderPass(renderingCommandBuffers[imageIndex], &shadowsRenderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(renderingCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[shadowsGraphicsPipelineIndex]);
-		vkCmdPushConstants(renderingCommandBuffers[imageIndex], graphicsPipelineLayouts[shadowsGraphicsPipelineIndex], VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(int), &j);
-
-		vkCmdBindVertexBuffers(renderingCommandBuffers[imageIndex], 0, 1, vertexCmdBuffers, offset);
-		vkCmdBindIndexBuffer(renderingCommandBuffers[imageIndex], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-		for (Object* obj : scene->getElements()) {
-			Model* model = obj->getModel();
-			vkCmdBindDescriptorSets(renderingCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayouts[shadowsGraphicsPipelineIndex], 0, 1, &obj->getShadowsDescriptorSets()->at(imageIndex), 0, nullptr);
-			for (Mesh mesh : model->getMeshes()) {
-				vkCmdDrawIndexed(renderingCommandBuffers[imageIndex], static_cast<uint32_t>(mesh.indexSize), 1, (uint32_t)mesh.indexOffset, (int32_t)model->getVertexOffset(), 0);
+		vkCmdBeginRenderPass(renderingCommandBuffers[imageIndex], &shadowsRenderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(renderingCommandBuffers[imageIndex], 1, &frameCommands.secondaryCommandBuffers[j]);
+		vkCmdEndRenderPass(renderingCommandBuffers[imageIndex]);
+	}
+
+	// Second pass : Objects, slices are executed in draw list order
+	vkCmdBeginRenderPass(renderingCommandBuffers[imageIndex], &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	vkCmdExecuteCommands(renderingCommandBuffers[imageIndex], frameCommands.objectsSliceCount, &frameCommands.secondaryCommandBuffers[frameCommands.shadowsPassCount]);
+	if (!occlusion) {
+		vkCmdExecuteCommands(renderingCommandBuffers[imageIndex], 1, &skyboxCommandBuffer);
+	}
+	vkCmdEndRenderPass(renderingCommandBuffers[imageIndex]);
+
+	// Third pass : Objects hidden in the previous frame found visible against the depth of the second pass
+	if (occlusion) {
+		recordOcclusionCullingPass(renderingCommandBuffers[imageIndex]);
+
+		VkRenderPassBeginInfo occlusionRenderPassInfo = renderPassInfo;
+		occlusionRenderPassInfo.renderPass = occlusionRenderPass;
+		vkCmdBeginRenderPass(renderingCommandBuffers[imageIndex], &occlusionRenderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(renderingCommandBuffers[imageIndex], frameCommands.occlusionSliceCount, &frameCommands.secondaryCommandBuffers[frameCommands.shadowsPassCount + frameCommands.objectsSliceCount]);
+		vkCmdExecuteCommands(renderingCommandBuffers[imageIndex], 1, &skyboxCommandBuffer);
+		vkCmdEndRenderPass(renderingCommandBuffers[imageIndex]);
+	}
+
+	if (vkEndCommandBuffer(renderingCommandBuffers[imageIndex]) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record command buffer!");
+	}
+}
+
+void Renderer::recordSecondaryCommandBuffers(RecordedCommands& frameCommands) {
+	// Every thread's pool is reset, the secondary command buffers allocated from it are reused
+	for (RecordingCommandPool& recordingCommandPool : frameCommands.commandPools) {
+		vkResetCommandPool(device, recordingCommandPool.commandPool, 0);
+		recordingCommandPool.usedSecondaryCommandBuffers = 0;
+	}
+
+	// Shadow passes and slices of the main pass are recorded in parallel, each in its own secondary command buffer
+	uint32_t shadowsPassCount = static_cast<uint32_t>(scene->getDirectionalLights().size() + scene->getSpotLights().size());
+	uint32_t objectsDrawCount = static_cast<uint32_t>(indirectDraw ? indirectBatches.size() : viewDrawGroups[0].size());
+	uint32_t drawSliceCount = std::max(std::min(recordingThreads.getThreadCount(), (objectsDrawCount + MIN_RECORDING_SLICE_SIZE - 1) / MIN_RECORDING_SLICE_SIZE), 1u);
+	// With the depth pre-pass, the slices drawing the depth of every draw come before the slices shading them
+	uint32_t objectsSliceCount = depthPrepass ? 2 * drawSliceCount : drawSliceCount;
+	// The occlusion culling's second phase draws the same batches from its own view
+	uint32_t occlusionSliceCount = isOcclusionCullingActive() ? objectsSliceCount : 0;
+	frameCommands.shadowsPassCount = shadowsPassCount;
+	frameCommands.objectsSliceCount = objectsSliceCount;
+	frameCommands.occlusionSliceCount = occlusionSliceCount;
+	frameCommands.secondaryCommandBuffers.resize(shadowsPassCount + objectsSliceCount + occlusionSliceCount);
+	recordingThreads.run(static_cast<uint32_t>(frameCommands.secondaryCommandBuffers.size()), [this, &frameCommands, shadowsPassCount, objectsDrawCount, drawSliceCount, objectsSliceCount](uint32_t task, uint32_t thread) {
+		// Kept for the next frames, the framebuffer depends on the swapchain image so it is not given
+		VkCommandBuffer commandBuffer;
+		if (task < shadowsPassCount) {
+			commandBuffer = beginSecondaryCommandBuffer(frameCommands.commandPools[thread], shadowsRenderPass, VK_NULL_HANDLE, 0);
+			recordShadowsPass(commandBuffer, static_cast<int>(task));
+		}
+		else {
+			uint32_t passSlice = (task - shadowsPassCount) % objectsSliceCount;
+			bool occlusionSlice = task - shadowsPassCount >= objectsSliceCount;
+			bool depthSlice = depthPrepass && passSlice < drawSliceCount;
+			uint32_t slice = passSlice % drawSliceCount;
+			uint32_t firstDraw = static_cast<uint32_t>(static_cast<uint64_t>(slice) * objectsDrawCount / drawSliceCount);
+			uint32_t lastDraw = static_cast<uint32_t>(static_cast<uint64_t>(slice + 1) * objectsDrawCount / drawSliceCount);
+			commandBuffer = beginSecondaryCommandBuffer(frameCommands.commandPools[thread], occlusionSlice ? occlusionRenderPass : renderPass, VK_NULL_HANDLE, 0);
+			if (depthSlice) {
+				recordDepthPrepass(commandBuffer, occlusionSlice ? cullingViewCount : 0, firstDraw, lastDraw - firstDraw);
+			}
+			else {
+				recordObjectsPass(commandBuffer, occlusionSlice ? cullingViewCount : 0, firstDraw, lastDraw - firstDraw);
 			}
 		}
 
-		vkCmdEndRenderPass(renderingCommandBuffers[imageIndex]);
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record secondary command buffer!");
+		}
+		frameCommands.secondaryCommandBuffers[task] = commandBuffer;
+	});
+}
+
+uint64_t Renderer::getDrawStateHash() {
+	// Everything recorded in the secondary command buffers that is not read from buffers, FNV-1a over the draws
+	uint64_t hash = 14695981039346656037ULL;
+	auto combine = [&hash](uint64_t value) {
+		hash = (hash ^ value) * 1099511628211ULL;
+	};
+
+	combine(indirectDraw ? 1 : 0);
+	combine(isOcclusionCullingActive() ? 1 : 0);
+	combine(depthPrepass ? 1 : 0);
+	combine(scene->getDirectionalLights().size() + scene->getSpotLights().size());
+	combine(cameraBufferOffset);
+	combine(lightsBufferOffset);
+	combine(shadowsBufferOffset);
+	if (indirectDraw) {
+		combine(indirectDrawCount);
+		for (IndirectBatch& batch : indirectBatches) {
+			combine(batch.graphicsPipelineIndex);
+			combine(reinterpret_cast<uint64_t>(batch.material));
+			combine(batch.firstDraw);
+			combine(batch.drawCount);
+		}
+	}
+	else {
+		for (std::vector<DrawGroup>& groups : viewDrawGroups) {
+			combine(groups.size());
+			for (DrawGroup& drawGroup : groups) {
+				combine(drawGroup.graphicsPipelineIndex);
+				combine(reinterpret_cast<uint64_t>(drawGroup.material));
+				combine(reinterpret_cast<uint64_t>(drawGroup.model));
+				combine(drawGroup.objects.size());
+				combine(drawGroup.firstInstance);
+			}
+		}
 	}
 
-	// Second pass : Objects
-	vkCmdBeginRenderPass(renderingCommandBuffers[imageIndex], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	return hash;
+}
 
-	vkCmdBindVertexBuffers(renderingCommandBuffers[imageIndex], 0, 1, vertexCmdBuffers, offset);
-	vkCmdBindIndexBuffer(renderingCommandBuffers[imageIndex], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+void Renderer::invalidateRecordedCommands() {
+	for (RecordedCommands& frameCommands : recordedCommands) {
+		frameCommands.valid = false;
+	}
+}
 
-	for (Object* obj : scene->getElements()) {
-		Model* model = obj->getModel();
-		vkCmdBindPipeline(renderingCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[obj->getGraphicsPipelineIndex()]);
-		vkCmdBindDescriptorSets(renderingCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayouts[obj->getGraphicsPipelineIndex()], 0, 1, &obj->getDescriptorSets()->at(imageIndex), 0, nullptr);
-		for (Mesh mesh : model->getMeshes()) {
-			vkCmdDrawIndexed(renderingCommandBuffers[imageIndex], static_cast<uint32_t>(mesh.indexSize), 1, (int32_t)mesh.indexOffset, (uint32_t)model->getVertexOffset(), 0);
+VkCommandBuffer Renderer::beginSecondaryCommandBuffer(RecordingCommandPool& recordingCommandPool, VkRenderPass secondaryRenderPass, VkFramebuffer framebuffer, VkCommandBufferUsageFlags flags) {
+	// Secondary command buffers are allocated the first time a pool needs more of them than before
+	if (recordingCommandPool.usedSecondaryCommandBuffers == recordingCommandPool.secondaryCommandBuffers.size()) {
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = recordingCommandPool.commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer secondaryCommandBuffer;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &secondaryCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate secondary command buffer!");
 		}
+		recordingCommandPool.secondaryCommandBuffers.push_back(secondaryCommandBuffer);
 	}
+	VkCommandBuffer commandBuffer = recordingCommandPool.secondaryCommandBuffers[recordingCommandPool.usedSecondaryCommandBuffers++];
 
-	// Skybox is drawn last
-	vkCmdBindPipeline(renderingCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[skyboxGraphicsPipelineIndex]);
-	vkCmdBindDescriptorSets(renderingCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayouts[skyboxGraphicsPipelineIndex], 0, 1, &skyboxDescriptorSets[imageIndex], 0, nullptr);
-	vkCmdDrawIndexed(renderingCommandBuffers[imageIndex], static_cast<uint32_t>(skyboxIndexSize), 1, 0, (int32_t)skyboxIndexOffset, (uint32_t)skyboxVertexOffset);
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = secondaryRenderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = framebuffer;
 
-	vkCmdEndRenderPass(renderingCommandBuffers[imageIndex]);
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = flags | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
 
-	if (vkEndCommandBuffer(renderingCommandBuffers[imageIndex]) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to record command buffer!");
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording secondary command buffer!");
+	}
+
+	return commandBuffer;
+}
+
+void Renderer::recordShadowsPass(VkCommandBuffer commandBuffer, int light) {
+	VkBuffer vertexCmdBuffers[] = { vertexBufferAllocation->buffer };
+	VkDeviceSize offset[] = { vertexBufferAllocation->offset };
+
+	// Frame's region in the objects buffer, shadows offset in the ring buffer then frame's region in the instances buffer, in binding order
+	uint32_t objectBufferOffset = getObjectBufferOffset(static_cast<uint32_t>(currentFrame));
+	uint32_t instanceBufferOffset = static_cast<uint32_t>(currentFrame * instanceBufferFrameSize);
+	std::array<uint32_t, 3> shadowsDynamicOffsets = { objectBufferOffset, shadowsBufferOffset, instanceBufferOffset };
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[shadowsGraphicsPipelineIndex]);
+	vkCmdPushConstants(commandBuffer, graphicsPipelineLayouts[shadowsGraphicsPipelineIndex], VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(int), &light);
+
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexCmdBuffers, offset);
+	vkCmdBindIndexBuffer(commandBuffer, indexBufferAllocation->buffer, indexBufferAllocation->offset, VK_INDEX_TYPE_UINT32);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayouts[shadowsGraphicsPipelineIndex], 0, 1, &shadowsDescriptorSets[currentFrame], static_cast<uint32_t>(shadowsDynamicOffsets.size()), shadowsDynamicOffsets.data());
+	// One instanced draw per mesh of each group, the instances are the group's objects
+	if (indirectDraw) {
+		drawIndirect(commandBuffer, 1 + light, 0, 0, indirectDrawCount);
+	}
+	else {
+		for (DrawGroup& drawGroup : viewDrawGroups[1 + light]) {
+			Model* model = drawGroup.model;
+			for (Mesh mesh : model->getMeshes()) {
+				vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh.indexSize), static_cast<uint32_t>(drawGroup.objects.size()), (uint32_t)mesh.indexOffset, (int32_t)model->getVertexOffset(), drawGroup.firstInstance);
+			}
+		}
+	}
+}
+
+void Renderer::recordObjectsPass(VkCommandBuffer commandBuffer, uint32_t view, uint32_t firstDraw, uint32_t drawCount) {
+	VkBuffer vertexCmdBuffers[] = { vertexBufferAllocation->buffer };
+	VkDeviceSize offset[] = { vertexBufferAllocation->offset };
+
+	// Frame's region in the objects buffer, camera, lights and shadows offsets in the ring buffer then frame's region in the instances buffer, in binding order
+	uint32_t objectBufferOffset = getObjectBufferOffset(static_cast<uint32_t>(currentFrame));
+	uint32_t instanceBufferOffset = static_cast<uint32_t>(currentFrame * instanceBufferFrameSize);
+	std::array<uint32_t, 5> dynamicOffsets = { objectBufferOffset, cameraBufferOffset, lightsBufferOffset, shadowsBufferOffset, instanceBufferOffset };
+
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexCmdBuffers, offset);
+	vkCmdBindIndexBuffer(commandBuffer, indexBufferAllocation->buffer, indexBufferAllocation->offset, VK_INDEX_TYPE_UINT32);
+
+	// After the depth pre-pass, the PBR pipeline only keeps the fragments with the depth it wrote
+	auto objectsGraphicsPipelineIndex = [this](int graphicsPipelineIndex) {
+		return (depthPrepass && graphicsPipelineIndex == pbrGraphicsPipelineIndex) ? pbrDepthEqualGraphicsPipelineIndex : graphicsPipelineIndex;
+	};
+
+	// Pipelines and materials are only bound when they change, draws are indirect batches or draw groups
+	int boundGraphicsPipelineIndex = -1;
+	Material* boundMaterial = nullptr;
+	if (indirectDraw) {
+		for (uint32_t i = firstDraw; i < firstDraw + drawCount; i++) {
+			IndirectBatch& batch = indirectBatches[i];
+			if (objectsGraphicsPipelineIndex(batch.graphicsPipelineIndex) != boundGraphicsPipelineIndex) {
+				boundGraphicsPipelineIndex = objectsGraphicsPipelineIndex(batch.graphicsPipelineIndex);
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[boundGraphicsPipelineIndex]);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayouts[boundGraphicsPipelineIndex], 0, 1, &descriptorSets[currentFrame], static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+			}
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayouts[boundGraphicsPipelineIndex], 1, 1, batch.material->getDescriptorSet(static_cast<uint32_t>(currentFrame)), 0, nullptr);
+			drawIndirect(commandBuffer, view, i, batch.firstDraw, batch.drawCount);
+		}
+	}
+	else {
+		for (uint32_t i = firstDraw; i < firstDraw + drawCount; i++) {
+			DrawGroup& drawGroup = viewDrawGroups[0][i];
+			Model* model = drawGroup.model;
+			if (objectsGraphicsPipelineIndex(drawGroup.graphicsPipelineIndex) != boundGraphicsPipelineIndex) {
+				boundGraphicsPipelineIndex = objectsGraphicsPipelineIndex(drawGroup.graphicsPipelineIndex);
+				boundMaterial = nullptr;
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[boundGraphicsPipelineIndex]);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayouts[boundGraphicsPipelineIndex], 0, 1, &descriptorSets[currentFrame], static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+			}
+			if (drawGroup.material != boundMaterial) {
+				boundMaterial = drawGroup.material;
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayouts[boundGraphicsPipelineIndex], 1, 1, boundMaterial->getDescriptorSet(static_cast<uint32_t>(currentFrame)), 0, nullptr);
+			}
+			for (Mesh mesh : model->getMeshes()) {
+				vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh.indexSize), static_cast<uint32_t>(drawGroup.objects.size()), static_cast<uint32_t>(mesh.indexOffset), static_cast<int32_t>(model->getVertexOffset()), drawGroup.firstInstance);
+			}
+		}
+	}
+}
+
+void Renderer::recordDepthPrepass(VkCommandBuffer commandBuffer, uint32_t view, uint32_t firstDraw, uint32_t drawCount) {
+	VkBuffer vertexCmdBuffers[] = { vertexBufferAllocation->buffer };
+	VkDeviceSize offset[] = { vertexBufferAllocation->offset };
+
+	// Same descriptor set as the objects pass, only the objects, camera and instances are read
+	uint32_t objectBufferOffset = getObjectBufferOffset(static_cast<uint32_t>(currentFrame));
+	uint32_t instanceBufferOffset = static_cast<uint32_t>(currentFrame * instanceBufferFrameSize);
+	std::array<uint32_t, 5> dynamicOffsets = { objectBufferOffset, cameraBufferOffset, lightsBufferOffset, shadowsBufferOffset, instanceBufferOffset };
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[depthPrepassGraphicsPipelineIndex]);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayouts[depthPrepassGraphicsPipelineIndex], 0, 1, &descriptorSets[currentFrame], static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexCmdBuffers, offset);
+	vkCmdBindIndexBuffer(commandBuffer, indexBufferAllocation->buffer, indexBufferAllocation->offset, VK_INDEX_TYPE_UINT32);
+
+	// Materials are not needed, the draws are the same as the objects pass's
+	if (indirectDraw) {
+		for (uint32_t i = firstDraw; i < firstDraw + drawCount; i++) {
+			IndirectBatch& batch = indirectBatches[i];
+			drawIndirect(commandBuffer, view, i, batch.firstDraw, batch.drawCount);
+		}
+	}
+	else {
+		for (uint32_t i = firstDraw; i < firstDraw + drawCount; i++) {
+			DrawGroup& drawGroup = viewDrawGroups[0][i];
+			Model* model = drawGroup.model;
+			for (Mesh mesh : model->getMeshes()) {
+				vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh.indexSize), static_cast<uint32_t>(drawGroup.objects.size()), (uint32_t)mesh.indexOffset, (int32_t)model->getVertexOffset(), drawGroup.firstInstance);
+			}
+		}
 	}
 }
 
@@ -1262,6 +1996,22 @@ bool Renderer::checkDeviceExtensionSupport(VkPhysicalDevice device) {
 	return requiredExtensions.empty();
 }
 
+bool Renderer::checkOptionalDeviceExtensionSupport(VkPhysicalDevice device, const char* extension) {
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& availableExtension : availableExtensions) {
+		if (strcmp(availableExtension.extensionName, extension) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 QueueFamilyIndices Renderer::findQueueFamilies(VkPhysicalDevice device) {
 	QueueFamilyIndices indices;
 
@@ -1361,19 +2111,7 @@ VkExtent2D Renderer::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabiliti
 	}
 }
 
-uint32_t Renderer::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-			return i;
-		}
-	}
-	throw std::runtime_error("Failed to find suitable memory type!");
-}
-
-void Renderer::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image) {
+void Renderer::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation*& imageAllocation, bool movable) {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1393,72 +2131,447 @@ void Renderer::createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
 		throw std::runtime_error("Failed to create image!");
 	}
 
-	memoryAllocator.allocate(&image, properties);
-}
-
-void Renderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = size;
-	bufferInfo.usage = usage;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create buffer!");
+	// Attachments are not movable, they get their own memory
+	imageAllocation = memoryAllocator.allocate(&image, tiling, properties, !movable);
+	// Movable images can be moved by the defragmentation, they are sampled in the shaders
+	if (movable) {
+		memoryAllocator.setMovable(imageAllocation, imageInfo, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	}
+}
 
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate vertex buffer memory!");
-	}
-	vkBindBufferMemory(device, buffer, bufferMemory, 0);
+void Renderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, Allocation*& bufferAllocation) {
+	// Sub-allocated from a buffer shared by the allocations of the same usage
+	bufferAllocation = memoryAllocator.allocate(size, usage, properties);
 }
 
-void Renderer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+void Renderer::copyBuffer(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size) {
 	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
 	VkBufferCopy copyRegion = {};
-	copyRegion.srcOffset = 0;
-	copyRegion.dstOffset = 0;
+	copyRegion.srcOffset = srcOffset;
+	copyRegion.dstOffset = dstOffset;
 	copyRegion.size = size;
 	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
 	endSingleTimeCommands(commandBuffer);
 }
 
-void Renderer::updateUniformBuffer(Object* obj, uint32_t currentImage) {
-	void* data;
+uint64_t Renderer::getDrawKey(Object* obj) {
+	// Distance along the camera's direction, objects behind the camera come first
+	Camera* camera = scene->getCamera();
+	float depth = (obj->getPositionX() - camera->getPositionX()) * camera->getFrontX() + (obj->getPositionY() - camera->getPositionY()) * camera->getFrontY() + (obj->getPositionZ() - camera->getPositionZ()) * camera->getFrontZ();
+	depth = std::max(depth, 0.0f);
+	// Bits of a positive float are ordered like the float, the top 24 give the depth bucket
+	uint32_t depthBits;
+	std::memcpy(&depthBits, &depth, sizeof(float));
+
+	// Pipeline (8 bits), material (16 bits), model (16 bits), depth bucket (24 bits)
+	return (static_cast<uint64_t>(obj->getGraphicsPipelineIndex() & 0xFF) << 56)
+		| (static_cast<uint64_t>(obj->getMaterial()->getIndex() & 0xFFFF) << 40)
+		| (static_cast<uint64_t>(obj->getModel()->getIndex() & 0xFFFF) << 24)
+		| static_cast<uint64_t>(depthBits >> 7);
+}
 
-	ObjectBufferObject obo = {};
-	// Using T * R * S transformation for models
-	glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(obj->getPositionX(), obj->getPositionY(), obj->getPositionZ()));
-	glm::mat4 rotateX = glm::rotate(glm::mat4(1.0f), glm::radians(obj->getRotationX()), glm::vec3(1.0f, 0.0f, 0.0f));
-	glm::mat4 rotateY = glm::rotate(glm::mat4(1.0f), glm::radians(obj->getRotationY()), glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 rotateZ = glm::rotate(glm::mat4(1.0f), glm::radians(obj->getRotationZ()), glm::vec3(0.0f, 0.0f, 1.0f));
-	glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(obj->getScale()));
-	obo.model = translate * rotateX * rotateY * rotateZ * scale;
+void Renderer::sortDrawList() {
+	if (drawList.empty()) {
+		return;
+	}
 
-	vkMapMemory(device, obj->getObjectBufferMemories()->at(currentImage), 0, sizeof(obo), 0, &data);
-	memcpy(data, &obo, sizeof(obo));
-	vkUnmapMemory(device, obj->getObjectBufferMemories()->at(currentImage));
-}
+	// Least significant digit radix sort on 8 bits digits, stable so each pass keeps the order of the previous ones
+	drawListScratch.resize(drawList.size());
+	for (uint32_t shift = 0; shift < 64; shift += 8) {
+		std::array<size_t, 256> counts = {};
+		for (const DrawItem& item : drawList) {
+			counts[(item.key >> shift) & 0xFF]++;
+		}
+		// Every key has the same digit, nothing to move
+		if (counts[(drawList[0].key >> shift) & 0xFF] == drawList.size()) {
+			continue;
+		}
 
-VkCommandBuffer Renderer::beginSingleTimeCommands() {
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = singleTimeCommandPool;
-	allocInfo.commandBufferCount = 1;
+		size_t offset = 0;
+		for (size_t& count : counts) {
+			size_t digitCount = count;
+			count = offset;
+			offset += digitCount;
+		}
+		for (const DrawItem& item : drawList) {
+			drawListScratch[counts[(item.key >> shift) & 0xFF]++] = item;
+		}
+		drawList.swap(drawListScratch);
+	}
+}
 
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+void Renderer::updateDrawList(uint32_t frame) {
+	drawList.clear();
+	for (Object* obj : scene->getElements()) {
+		drawList.push_back({ getDrawKey(obj), obj });
+	}
+	sortDrawList();
+
+	// Indirect draws' instances are written by the culling pass
+	if (indirectDraw) {
+		buildDrawGroups(nullptr, 0, drawGroups);
+		updateIndirectBuffer(frame);
+		return;
+	}
+
+	// Each view only draws the objects in its frustum, its instances start at view * number of objects
+	for (Object* obj : scene->getElements()) {
+		const float* boundingSphere = obj->getWorldBoundingSphere();
+		frustumCuller.setSphere(obj->getObjectBufferIndex(), boundingSphere[0], boundingSphere[1], boundingSphere[2], boundingSphere[3]);
+	}
+	for (uint32_t view = 0; view < viewDrawGroups.size(); view++) {
+		frustumCuller.cull(reinterpret_cast<const float*>(&cullingBufferObject.frustumPlanes[view * 6]), objectVisibility.data());
+		buildDrawGroups(objectVisibility.data(), view * static_cast<uint32_t>(drawList.size()), viewDrawGroups[view]);
+	}
+	updateInstanceBuffer(frame);
+}
+
+void Renderer::buildDrawGroups(const uint8_t* visibility, uint32_t firstInstance, std::vector<DrawGroup>& groups) {
+	// Consecutive objects with the same pipeline, material and model make a group, its instances are front-to-back
+	const uint64_t groupMask = ~static_cast<uint64_t>(0xFFFFFF);
+	uint64_t groupKey = 0;
+	groups.clear();
+	for (DrawItem& item : drawList) {
+		Object* obj = item.object;
+		if (visibility && !visibility[obj->getObjectBufferIndex()]) {
+			continue;
+		}
+		if (groups.empty() || (item.key & groupMask) != groupKey) {
+			groupKey = item.key & groupMask;
+			DrawGroup drawGroup = {};
+			drawGroup.model = obj->getModel();
+			drawGroup.material = obj->getMaterial();
+			drawGroup.graphicsPipelineIndex = obj->getGraphicsPipelineIndex();
+			drawGroup.firstInstance = firstInstance;
+			groups.push_back(drawGroup);
+		}
+		groups.back().objects.push_back(obj);
+		firstInstance++;
+	}
+}
+
+void Renderer::updateInstanceBuffer(uint32_t frame) {
+	uint32_t* instances = reinterpret_cast<uint32_t*>(static_cast<char*>(memoryAllocator.mappedPtr(instanceBufferAllocation)) + frame * instanceBufferFrameSize);
+	for (std::vector<DrawGroup>& groups : viewDrawGroups) {
+		for (DrawGroup& drawGroup : groups) {
+			for (size_t i = 0; i < drawGroup.objects.size(); i++) {
+				instances[drawGroup.firstInstance + i] = drawGroup.objects[i]->getObjectBufferIndex();
+			}
+		}
+	}
+}
+
+void Renderer::updateIndirectBuffer(uint32_t frame) {
+	// Each mesh of a group is a draw with its own instances, so the culling pass tests every mesh of every object
+	CullingDraw* draws = reinterpret_cast<CullingDraw*>(static_cast<char*>(memoryAllocator.mappedPtr(cullingDrawBufferAllocation)) + frame * cullingDrawBufferFrameSize);
+	CullingInstance* instances = reinterpret_cast<CullingInstance*>(static_cast<char*>(memoryAllocator.mappedPtr(cullingInstanceBufferAllocation)) + frame * cullingInstanceBufferFrameSize);
+	indirectDrawCount = 0;
+	cullingInstanceCount = 0;
+	indirectBatches.clear();
+	for (DrawGroup& drawGroup : drawGroups) {
+		// Groups are sorted so a batch holds every consecutive group with the same pipeline and material
+		if (indirectBatches.empty() || indirectBatches.back().graphicsPipelineIndex != drawGroup.graphicsPipelineIndex || indirectBatches.back().material != drawGroup.material) {
+			indirectBatches.push_back({ drawGroup.graphicsPipelineIndex, drawGroup.material, indirectDrawCount, 0 });
+		}
+
+		Model* model = drawGroup.model;
+		for (Mesh& mesh : model->getMeshes()) {
+			CullingDraw& draw = draws[indirectDrawCount];
+			draw.boundingSphere = glm::vec4(mesh.boundingSphere[0], mesh.boundingSphere[1], mesh.boundingSphere[2], mesh.boundingSphere[3]);
+			draw.indexCount = static_cast<uint32_t>(mesh.indexSize);
+			draw.firstIndex = static_cast<uint32_t>(mesh.indexOffset);
+			draw.vertexOffset = static_cast<int32_t>(model->getVertexOffset());
+			draw.firstInstance = cullingInstanceCount;
+			draw.batch = static_cast<uint32_t>(indirectBatches.size() - 1);
+			draw.batchFirstDraw = indirectBatches.back().firstDraw;
+			for (Object* obj : drawGroup.objects) {
+				instances[cullingInstanceCount++] = { indirectDrawCount, obj->getObjectBufferIndex() };
+			}
+			indirectDrawCount++;
+			indirectBatches.back().drawCount++;
+		}
+	}
+
+	// Each frame reads the visibility written by the previous one
+	occlusionParity ^= OCCLUSION_PARITY;
+	uint32_t occlusionFlags = occlusionParity | (isOcclusionCullingActive() ? OCCLUSION_ENABLED : 0);
+	cullingBufferObject.occlusion = glm::uvec4(depthPyramidWidth, depthPyramidHeight, depthPyramidLevels, occlusionFlags);
+
+	void* data;
+	cullingBufferObject.counts = glm::uvec4(cullingViewCount + 1, indirectDrawCount, cullingInstanceCount, drawIndirectCountSupported ? 1 : 0);
+	cullingBufferOffset = static_cast<uint32_t>(memoryAllocator.ringAllocate(sizeof(cullingBufferObject), &data));
+	memcpy(data, &cullingBufferObject, sizeof(cullingBufferObject));
+}
+
+void Renderer::drawIndirect(VkCommandBuffer commandBuffer, uint32_t view, uint32_t batch, uint32_t firstDraw, uint32_t drawCount) {
+	// Each view's commands and counts follow the previous view's
+	VkDeviceSize commandOffset = indirectBufferAllocation->offset + currentFrame * indirectBufferFrameSize + (static_cast<VkDeviceSize>(view) * indirectDrawCount + firstDraw) * sizeof(VkDrawIndexedIndirectCommand);
+	if (drawIndirectCountSupported) {
+		VkDeviceSize countOffset = cullingCountBufferAllocation->offset + currentFrame * cullingCountBufferFrameSize + (static_cast<VkDeviceSize>(view) * indirectDrawCount + batch) * sizeof(uint32_t);
+		vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBufferAllocation->buffer, commandOffset, cullingCountBufferAllocation->buffer, countOffset, drawCount, sizeof(VkDrawIndexedIndirectCommand));
+		return;
+	}
+
+	// Culled draws are kept with no instance
+	while (drawCount > 0) {
+		uint32_t count = std::min(drawCount, maxDrawIndirectCount);
+		vkCmdDrawIndexedIndirect(commandBuffer, indirectBufferAllocation->buffer, commandOffset, count, sizeof(VkDrawIndexedIndirectCommand));
+		commandOffset += count * sizeof(VkDrawIndexedIndirectCommand);
+		drawCount -= count;
+	}
+}
+
+void Renderer::recordCullingPass(VkCommandBuffer commandBuffer) {
+	if (indirectDrawCount == 0) {
+		return;
+	}
+
+	// Counts are incremented by the pass
+	vkCmdFillBuffer(commandBuffer, cullingCountBufferAllocation->buffer, cullingCountBufferAllocation->offset + currentFrame * cullingCountBufferFrameSize, cullingCountBufferFrameSize, 0);
+
+	// The previous frame's culling wrote the visibility read by this one
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// The camera and the lights, the camera's draws are the objects visible in the previous frame with occlusion culling
+	recordCullingSteps(commandBuffer, 0, cullingViewCount);
+}
+
+void Renderer::recordOcclusionCullingPass(VkCommandBuffer commandBuffer) {
+	if (indirectDrawCount == 0) {
+		return;
+	}
+
+	// The objects not drawn by the first phase are tested against the depth it wrote
+	recordDepthPyramid(commandBuffer);
+	recordCullingSteps(commandBuffer, cullingViewCount, 1);
+}
+
+void Renderer::recordCullingSteps(VkCommandBuffer commandBuffer, uint32_t firstView, uint32_t viewCount) {
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullingPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullingPipelineLayout, 0, 1, &cullingDescriptorSets[currentFrame], 1, &cullingBufferOffset);
+
+	// Visible instances of each draw and view
+	std::array<uint32_t, 3> cullingStep = { 0, firstView, viewCount };
+	vkCmdPushConstants(commandBuffer, cullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) * static_cast<uint32_t>(cullingStep.size()), cullingStep.data());
+	vkCmdDispatch(commandBuffer, (viewCount * cullingInstanceCount + CULLING_WORKGROUP_SIZE - 1) / CULLING_WORKGROUP_SIZE, 1, 1);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// Draw commands of each view
+	cullingStep[0] = 1;
+	vkCmdPushConstants(commandBuffer, cullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) * static_cast<uint32_t>(cullingStep.size()), cullingStep.data());
+	vkCmdDispatch(commandBuffer, (viewCount * indirectDrawCount + CULLING_WORKGROUP_SIZE - 1) / CULLING_WORKGROUP_SIZE, 1, 1);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Renderer::recordDepthPyramid(VkCommandBuffer commandBuffer) {
+	// Every level is rewritten, the previous frame's pyramid is discarded
+	// The first phase's culling wrote the visibility read by the second phase
+	VkImageMemoryBarrier imageBarrier = {};
+	imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageBarrier.srcAccessMask = 0;
+	imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier.image = depthPyramidImage;
+	imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageBarrier.subresourceRange.baseMipLevel = 0;
+	imageBarrier.subresourceRange.levelCount = depthPyramidLevels;
+	imageBarrier.subresourceRange.baseArrayLayer = 0;
+	imageBarrier.subresourceRange.layerCount = 1;
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 1, &imageBarrier);
+
+	// The first level takes the farthest sample of each pixel, each next level the farthest of 2x2 texels of the previous one
+	int32_t samples = static_cast<int32_t>(msaaSamples);
+	for (uint32_t i = 0; i < depthPyramidLevels; i++) {
+		if (i <= 1) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, i == 0 ? depthPyramidDepthPipeline : depthPyramidPipeline);
+		}
+		if (i == 0) {
+			vkCmdPushConstants(commandBuffer, depthPyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int32_t), &samples);
+		}
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipelineLayout, 0, 1, &depthPyramidDescriptorSets[i], 0, nullptr);
+
+		uint32_t levelWidth = std::max(depthPyramidWidth >> i, 1u);
+		uint32_t levelHeight = std::max(depthPyramidHeight >> i, 1u);
+		vkCmdDispatch(commandBuffer, (levelWidth + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE, (levelHeight + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE, 1);
+
+		// The next level and the culling pass read this one
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+}
+
+bool Renderer::isOcclusionCullingActive() {
+	return indirectDraw && occlusionCulling && occlusionCullingSupported;
+}
+
+void Renderer::extractFrustumPlanes(glm::mat4 viewProj, glm::vec4* planes) {
+	// Rows of the matrix, glm matrices are indexed by column
+	std::array<glm::vec4, 4> rows;
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+	}
+
+	// Left, right, bottom, top, near and far with a 0 to 1 depth, normals point inside the frustum
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[2];
+	planes[5] = rows[3] - rows[2];
+	for (int i = 0; i < 6; i++) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+void Renderer::updateUniformBuffer(Object* obj) {
+	ObjectBufferObject& obo = objectBufferData[obj->getObjectBufferIndex()];
+	// Using T * R * S transformation for models
+	glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(obj->getPositionX(), obj->getPositionY(), obj->getPositionZ()));
+	glm::mat4 rotateX = glm::rotate(glm::mat4(1.0f), glm::radians(obj->getRotationX()), glm::vec3(1.0f, 0.0f, 0.0f));
+	glm::mat4 rotateY = glm::rotate(glm::mat4(1.0f), glm::radians(obj->getRotationY()), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 rotateZ = glm::rotate(glm::mat4(1.0f), glm::radians(obj->getRotationZ()), glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(obj->getScale()));
+	obo.model = translate * rotateX * rotateY * rotateZ * scale;
+	// Computed once per object instead of for every vertex
+	obo.normal = glm::mat4(glm::transpose(glm::inverse(glm::mat3(obo.model))));
+	obo.materialIndex = obj->getMaterial()->getIndex();
+}
+
+void Renderer::updateObjectBuffer(uint32_t frame) {
+	ObjectBufferObject* objects = reinterpret_cast<ObjectBufferObject*>(static_cast<char*>(memoryAllocator.mappedPtr(objectBufferAllocation)) + getObjectBufferOffset(frame));
+	std::vector<uint64_t>& versions = objectBufferVersions[frame];
+	for (Object* obj : scene->getElements()) {
+		// Matrices are computed once when the transform changes then written in each frame's region still holding an older version
+		if (obj->isDirty()) {
+			updateUniformBuffer(obj);
+			obj->setDirty(false);
+		}
+		uint32_t index = obj->getObjectBufferIndex();
+		if (versions[index] != obj->getVersion()) {
+			// Written directly in the persistently mapped memory
+			memcpy(&objects[index], &objectBufferData[index], sizeof(ObjectBufferObject));
+			versions[index] = obj->getVersion();
+		}
+	}
+}
+
+uint32_t Renderer::getObjectBufferOffset(uint32_t frame) {
+	return static_cast<uint32_t>(frame * objectBufferFrameSize);
+}
+
+void Renderer::updateFrameBuffers() {
+	void* data;
+
+	// Camera
+	Camera* camera = scene->getCamera();
+	CameraBufferObject cbo = {};
+	cbo.view = glm::lookAt(glm::vec3(camera->getPositionX(), camera->getPositionY(), camera->getPositionZ()), glm::vec3(camera->getPositionX() + camera->getFrontX(), camera->getPositionY() + camera->getFrontY(), camera->getPositionZ() + camera->getFrontZ()), glm::vec3(camera->getUpX(), camera->getUpY(), camera->getUpZ()));
+	cbo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 1000.0f);
+	cbo.proj[1][1] *= -1;
+	cbo.pos = glm::vec3(camera->getPositionX(), camera->getPositionY(), camera->getPositionZ());
+
+	cameraBufferOffset = static_cast<uint32_t>(memoryAllocator.ringAllocate(sizeof(cbo), &data));
+	memcpy(data, &cbo, sizeof(cbo));
+
+	// Lights
+	LightsBufferObject lbo = {};
+	std::vector<DirectionalLight*> dirLights = scene->getDirectionalLights();
+	std::vector<PointLight*> pointLights = scene->getPointLights();
+	std::vector<SpotLight*> spotLights = scene->getSpotLights();
+	lbo.numLights.x = (float)dirLights.size();
+	lbo.numLights.y = (float)pointLights.size();
+	lbo.numLights.z = (float)spotLights.size();
+	for (size_t i = 0; i < dirLights.size(); i++) {
+		lbo.dirLightsDir[i] = glm::vec4(dirLights[i]->getDirectionX(), dirLights[i]->getDirectionY(), dirLights[i]->getDirectionZ(), 0.0f);
+		lbo.dirLightsColor[i] = glm::vec4(dirLights[i]->getColorR(), dirLights[i]->getColorG(), dirLights[i]->getColorB(), 0.0f);
+	}
+	for (size_t i = 0; i < pointLights.size(); i++) {
+		lbo.pointLightsPos[i] = glm::vec4(pointLights[i]->getPositionX(), pointLights[i]->getPositionY(), pointLights[i]->getPositionZ(), 0.0f);
+		lbo.pointLightsColor[i] = glm::vec4(pointLights[i]->getColorR(), pointLights[i]->getColorG(), pointLights[i]->getColorB(), 0.0f);
+	}
+	for (size_t i = 0; i < spotLights.size(); i++) {
+		lbo.spotLightsPos[i] = glm::vec4(spotLights[i]->getPositionX(), spotLights[i]->getPositionY(), spotLights[i]->getPositionZ(), 0.0f);
+		lbo.spotLightsDir[i] = glm::vec4(spotLights[i]->getDirectionX(), spotLights[i]->getDirectionY(), spotLights[i]->getDirectionZ(), 0.0f);
+		lbo.spotLightsColor[i] = glm::vec4(spotLights[i]->getColorR(), spotLights[i]->getColorG(), spotLights[i]->getColorB(), 0.0f);
+		lbo.spotLightsCutoffs[i] = glm::vec2(spotLights[i]->getCutoff(), spotLights[i]->getOutCutoff());
+	}
+
+	lightsBufferOffset = static_cast<uint32_t>(memoryAllocator.ringAllocate(sizeof(lbo), &data));
+	memcpy(data, &lbo, sizeof(lbo));
+
+	// Shadows
+	ShadowsBufferObject sbo = {};
+	sbo.numLights.x = (float)dirLights.size();
+	sbo.numLights.y = (float)pointLights.size();
+	sbo.numLights.z = (float)spotLights.size();
+	glm::vec3 eye;
+	glm::vec3 up;
+	glm::mat4 shadowsView;
+	glm::mat4 shadowsProj = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -10.0f, 20.0f);
+	for (int i = 0; i < dirLights.size(); i++) {
+		eye = glm::vec3(-dirLights[i]->getDirectionX(), -dirLights[i]->getDirectionY(), -dirLights[i]->getDirectionZ());
+		up = glm::dot(glm::vec3(0.0f, 1.0f, 0.0f), eye) == (glm::length(glm::vec3(0.0f, 1.0f, 0.0f)) * glm::length(eye)) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		shadowsView = glm::lookAt(eye, glm::vec3(0.0f), up);
+		sbo.dirLightsSpace[i] = shadowsProj * shadowsView;
+	}
+	for (int i = 0; i < spotLights.size(); i++) {
+		shadowsProj = glm::perspective(glm::radians(120.0f), SHADOWMAP_WIDTH / (float)SHADOWMAP_HEIGHT, 0.1f, 20.0f);
+		eye = glm::vec3(spotLights[i]->getPositionX(), spotLights[i]->getPositionY(), spotLights[i]->getPositionZ());
+		up = glm::dot(glm::vec3(0.0f, 1.0f, 0.0f), eye) == (glm::length(glm::vec3(0.0f, 1.0f, 0.0f)) * glm::length(eye)) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		shadowsView = glm::lookAt(eye, glm::vec3(spotLights[i]->getPositionX() + spotLights[i]->getDirectionX(), spotLights[i]->getPositionY() + spotLights[i]->getDirectionY(), spotLights[i]->getPositionZ() + spotLights[i]->getDirectionZ()), up);
+		sbo.spotLightsSpace[i] = shadowsProj * shadowsView;
+	}
+
+	shadowsBufferOffset = static_cast<uint32_t>(memoryAllocator.ringAllocate(sizeof(sbo), &data));
+	memcpy(data, &sbo, sizeof(sbo));
+
+	// Frustums of the culling pass, the camera then the lights in shadow passes order
+	cullingBufferObject.viewProj = cbo.proj * cbo.view;
+	extractFrustumPlanes(cullingBufferObject.viewProj, &cullingBufferObject.frustumPlanes[0]);
+	for (size_t i = 0; i < dirLights.size(); i++) {
+		extractFrustumPlanes(sbo.dirLightsSpace[i], &cullingBufferObject.frustumPlanes[(1 + i) * 6]);
+		// Casters behind the near plane still shadow the volume when they are clamped to it
+		if (depthClampSupported) {
+			cullingBufferObject.frustumPlanes[(1 + i) * 6 + 4] = glm::vec4(0.0f, 0.0f, 0.0f, std::numeric_limits<float>::max());
+		}
+	}
+	for (size_t i = 0; i < spotLights.size(); i++) {
+		extractFrustumPlanes(sbo.spotLightsSpace[i], &cullingBufferObject.frustumPlanes[(1 + dirLights.size() + i) * 6]);
+	}
+}
+
+VkCommandBuffer Renderer::beginSingleTimeCommands() {
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = singleTimeCommandPool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
 
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1540,6 +2653,13 @@ void Renderer::transitionImageLayout(VkImage image, VkFormat format, VkImageLayo
 		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 		destinationStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	}
+	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_GENERAL) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	}
 	else {
 		throw std::invalid_argument("unsupported layout transition!");
 	}
@@ -1549,13 +2669,13 @@ void Renderer::transitionImageLayout(VkImage image, VkFormat format, VkImageLayo
 	endSingleTimeCommands(commandBuffer);
 }
 
-void Renderer::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layers) {
+void Renderer::copyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t layers) {
 	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
 	std::vector<VkBufferImageCopy> regions;
 	for (uint32_t i = 0; i < layers; i++) {
 		VkBufferImageCopy region = {};
-		region.bufferOffset = (VkDeviceSize)width * height * i * 4;
+		region.bufferOffset = bufferOffset + (VkDeviceSize)width * height * i * 4;
 		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		region.imageSubresource.mipLevel = 0;
 		region.imageSubresource.baseArrayLayer = i;
@@ -1704,8 +2824,7 @@ VkSampleCountFlagBits Renderer::getMaxUsableSampleCount() {
 
 void Renderer::createTextureImage(Material* mat) {
 	// Diffuse Texture
-	VkBuffer diffuseStagingBuffer;
-	VkDeviceMemory diffuseStagingBufferMemory;
+	Allocation* diffuseStagingBufferAllocation;
 	VkDeviceSize diffuseImageSize;
 
 	int diffuseTexWidth, diffuseTexHeight, diffuseTexChannels;
@@ -1734,20 +2853,17 @@ void Renderer::createTextureImage(Material* mat) {
 	}
 
 	createBuffer(diffuseImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, diffuseStagingBuffer, diffuseStagingBufferMemory);
-	void* ddata;
-	vkMapMemory(device, diffuseStagingBufferMemory, 0, diffuseImageSize, 0, &ddata);
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, diffuseStagingBufferAllocation);
+	void* ddata = memoryAllocator.mappedPtr(diffuseStagingBufferAllocation);
 	memcpy(ddata, dPixels, static_cast<size_t>(diffuseImageSize));
-	vkUnmapMemory(device, diffuseStagingBufferMemory);
 	if (mat->getDiffusePath() != "") {
 		stbi_image_free(dPixels);
 	}
 
-	createImage(diffuseTexWidth, diffuseTexHeight, mat->getDiffuseMipLevel(), VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *mat->getDiffuseTextureImage());
+	createImage(diffuseTexWidth, diffuseTexHeight, mat->getDiffuseMipLevel(), VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *mat->getDiffuseTextureImage(), *mat->getDiffuseTextureAllocation(), true);
 
 	// Normal Texture
-	VkBuffer normalStagingBuffer;
-	VkDeviceMemory normalStagingBufferMemory;
+	Allocation* normalStagingBufferAllocation;
 	VkDeviceSize normalImageSize;
 
 	int normalTexWidth, normalTexHeight, normalTexChannels;
@@ -1774,20 +2890,17 @@ void Renderer::createTextureImage(Material* mat) {
 	}
 
 	createBuffer(normalImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, normalStagingBuffer, normalStagingBufferMemory);
-	void* ndata;
-	vkMapMemory(device, normalStagingBufferMemory, 0, normalImageSize, 0, &ndata);
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, normalStagingBufferAllocation);
+	void* ndata = memoryAllocator.mappedPtr(normalStagingBufferAllocation);
 	memcpy(ndata, nPixels, static_cast<size_t>(normalImageSize));
-	vkUnmapMemory(device, normalStagingBufferMemory);
 	if (mat->getNormalPath() != "") {
 		stbi_image_free(nPixels);
 	}
 
-	createImage(normalTexWidth, normalTexHeight, mat->getNormalMipLevel(), VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *mat->getNormalTextureImage());
+	createImage(normalTexWidth, normalTexHeight, mat->getNormalMipLevel(), VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *mat->getNormalTextureImage(), *mat->getNormalTextureAllocation(), true);
 
 	// Metallic Texture
-	VkBuffer metallicStagingBuffer;
-	VkDeviceMemory metallicStagingBufferMemory;
+	Allocation* metallicStagingBufferAllocation;
 	VkDeviceSize metallicImageSize;
 
 	int metallicTexWidth, metallicTexHeight, metallicTexChannels;
@@ -1812,20 +2925,17 @@ void Renderer::createTextureImage(Material* mat) {
 	}
 
 	createBuffer(metallicImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, metallicStagingBuffer, metallicStagingBufferMemory);
-	void* mdata;
-	vkMapMemory(device, metallicStagingBufferMemory, 0, metallicImageSize, 0, &mdata);
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, metallicStagingBufferAllocation);
+	void* mdata = memoryAllocator.mappedPtr(metallicStagingBufferAllocation);
 	memcpy(mdata, mPixels, static_cast<size_t>(metallicImageSize));
-	vkUnmapMemory(device, metallicStagingBufferMemory);
 	if (mat->getMetallicPath() != "") {
 		stbi_image_free(mPixels);
 	}
 
-	createImage(metallicTexWidth, metallicTexHeight, mat->getMetallicMipLevel(), VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *mat->getMetallicTextureImage());
+	createImage(metallicTexWidth, metallicTexHeight, mat->getMetallicMipLevel(), VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *mat->getMetallicTextureImage(), *mat->getMetallicTextureAllocation(), true);
 
 	// Roughness Texture
-	VkBuffer roughnessStagingBuffer;
-	VkDeviceMemory roughnessStagingBufferMemory;
+	Allocation* roughnessStagingBufferAllocation;
 	VkDeviceSize roughnessImageSize;
 	int roughnessTexWidth, roughnessTexHeight, roughnessTexChannels;
 
@@ -1851,20 +2961,17 @@ void Renderer::createTextureImage(Material* mat) {
 	}
 
 	createBuffer(roughnessImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, roughnessStagingBuffer, roughnessStagingBufferMemory);
-	void* rdata;
-	vkMapMemory(device, roughnessStagingBufferMemory, 0, roughnessImageSize, 0, &rdata);
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, roughnessStagingBufferAllocation);
+	void* rdata = memoryAllocator.mappedPtr(roughnessStagingBufferAllocation);
 	memcpy(rdata, rPixels, static_cast<size_t>(roughnessImageSize));
-	vkUnmapMemory(device, roughnessStagingBufferMemory);
 	if (mat->getRoughnessPath() != "") {
 		stbi_image_free(rPixels);
 	}
 
-	createImage(roughnessTexWidth, roughnessTexHeight, mat->getRoughnessMipLevel(), VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *mat->getRoughnessTextureImage());
+	createImage(roughnessTexWidth, roughnessTexHeight, mat->getRoughnessMipLevel(), VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *mat->getRoughnessTextureImage(), *mat->getRoughnessTextureAllocation(), true);
 
 	// AO Texture
-	VkBuffer AOStagingBuffer;
-	VkDeviceMemory AOStagingBufferMemory;
+	Allocation* AOStagingBufferAllocation;
 	VkDeviceSize AOImageSize;
 
 	int AOTexWidth, AOTexHeight, AOTexChannels;
@@ -1889,51 +2996,44 @@ void Renderer::createTextureImage(Material* mat) {
 	}
 
 	createBuffer(AOImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AOStagingBuffer, AOStagingBufferMemory);
-	void* adata;
-	vkMapMemory(device, AOStagingBufferMemory, 0, AOImageSize, 0, &adata);
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AOStagingBufferAllocation);
+	void* adata = memoryAllocator.mappedPtr(AOStagingBufferAllocation);
 	memcpy(adata, aPixels, static_cast<size_t>(AOImageSize));
-	vkUnmapMemory(device, AOStagingBufferMemory);
 	if (mat->getAOPath() != "") {
 		stbi_image_free(aPixels);
 	}
 
-	createImage(AOTexWidth, AOTexHeight, mat->getAOMipLevel(), VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *mat->getAOTextureImage());
+	createImage(AOTexWidth, AOTexHeight, mat->getAOMipLevel(), VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *mat->getAOTextureImage(), *mat->getAOTextureAllocation(), true);
 
 	transitionImageLayout(*mat->getDiffuseTextureImage(), VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mat->getDiffuseMipLevel(), 1);
-	copyBufferToImage(diffuseStagingBuffer, *mat->getDiffuseTextureImage(), static_cast<uint32_t>(diffuseTexWidth), static_cast<uint32_t>(diffuseTexHeight), 1);
+	copyBufferToImage(diffuseStagingBufferAllocation->buffer, diffuseStagingBufferAllocation->offset, *mat->getDiffuseTextureImage(), static_cast<uint32_t>(diffuseTexWidth), static_cast<uint32_t>(diffuseTexHeight), 1);
 	generateMipmaps(*mat->getDiffuseTextureImage(), VK_FORMAT_R8G8B8A8_SRGB, diffuseTexWidth, diffuseTexHeight, mat->getDiffuseMipLevel());
 
-	vkDestroyBuffer(device, diffuseStagingBuffer, nullptr);
-	vkFreeMemory(device, diffuseStagingBufferMemory, nullptr);
+	memoryAllocator.free(diffuseStagingBufferAllocation);
 
 	transitionImageLayout(*mat->getNormalTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mat->getNormalMipLevel(), 1);
-	copyBufferToImage(normalStagingBuffer, *mat->getNormalTextureImage(), static_cast<uint32_t>(normalTexWidth), static_cast<uint32_t>(normalTexHeight), 1);
+	copyBufferToImage(normalStagingBufferAllocation->buffer, normalStagingBufferAllocation->offset, *mat->getNormalTextureImage(), static_cast<uint32_t>(normalTexWidth), static_cast<uint32_t>(normalTexHeight), 1);
 	generateMipmaps(*mat->getNormalTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, normalTexWidth, normalTexHeight, mat->getNormalMipLevel());
 
-	vkDestroyBuffer(device, normalStagingBuffer, nullptr);
-	vkFreeMemory(device, normalStagingBufferMemory, nullptr);
+	memoryAllocator.free(normalStagingBufferAllocation);
 
 	transitionImageLayout(*mat->getMetallicTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mat->getMetallicMipLevel(), 1);
-	copyBufferToImage(metallicStagingBuffer, *mat->getMetallicTextureImage(), static_cast<uint32_t>(metallicTexWidth), static_cast<uint32_t>(metallicTexHeight), 1);
+	copyBufferToImage(metallicStagingBufferAllocation->buffer, metallicStagingBufferAllocation->offset, *mat->getMetallicTextureImage(), static_cast<uint32_t>(metallicTexWidth), static_cast<uint32_t>(metallicTexHeight), 1);
 	generateMipmaps(*mat->getMetallicTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, metallicTexWidth, metallicTexHeight, mat->getMetallicMipLevel());
 
-	vkDestroyBuffer(device, metallicStagingBuffer, nullptr);
-	vkFreeMemory(device, metallicStagingBufferMemory, nullptr);
+	memoryAllocator.free(metallicStagingBufferAllocation);
 
 	transitionImageLayout(*mat->getRoughnessTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mat->getRoughnessMipLevel(), 1);
-	copyBufferToImage(roughnessStagingBuffer, *mat->getRoughnessTextureImage(), static_cast<uint32_t>(roughnessTexWidth), static_cast<uint32_t>(roughnessTexHeight), 1);
+	copyBufferToImage(roughnessStagingBufferAllocation->buffer, roughnessStagingBufferAllocation->offset, *mat->getRoughnessTextureImage(), static_cast<uint32_t>(roughnessTexWidth), static_cast<uint32_t>(roughnessTexHeight), 1);
 	generateMipmaps(*mat->getRoughnessTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, roughnessTexWidth, roughnessTexHeight, mat->getRoughnessMipLevel());
 
-	vkDestroyBuffer(device, roughnessStagingBuffer, nullptr);
-	vkFreeMemory(device, roughnessStagingBufferMemory, nullptr);
+	memoryAllocator.free(roughnessStagingBufferAllocation);
 
 	transitionImageLayout(*mat->getAOTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mat->getAOMipLevel(), 1);
-	copyBufferToImage(AOStagingBuffer, *mat->getAOTextureImage(), static_cast<uint32_t>(AOTexWidth), static_cast<uint32_t>(AOTexHeight), 1);
+	copyBufferToImage(AOStagingBufferAllocation->buffer, AOStagingBufferAllocation->offset, *mat->getAOTextureImage(), static_cast<uint32_t>(AOTexWidth), static_cast<uint32_t>(AOTexHeight), 1);
 	generateMipmaps(*mat->getAOTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, AOTexWidth, AOTexHeight, mat->getAOMipLevel());
 
-	vkDestroyBuffer(device, AOStagingBuffer, nullptr);
-	vkFreeMemory(device, AOStagingBufferMemory, nullptr);
+	memoryAllocator.free(AOStagingBufferAllocation);
 }
 
 void Renderer::createTextureImageView(Material* mat) {
@@ -2009,8 +3109,7 @@ void Renderer::createTextureSampler(Material* mat) {
 void Renderer::createSkyboxTextureImage() {
 	Skybox* skybox = scene->getSkybox();
 
-	VkBuffer skyboxStagingBuffer;
-	VkDeviceMemory skyboxStagingBufferMemory;
+	Allocation* skyboxStagingBufferAllocation;
 	VkDeviceSize skyboxImageSize;
 
 	int skyboxTexWidth, skyboxTexHeight, skyboxTexChannels;
@@ -2042,9 +3141,9 @@ void Renderer::createSkyboxTextureImage() {
 	}
 
 	createBuffer(skyboxImageSize * 6, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, skyboxStagingBuffer, skyboxStagingBufferMemory);
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, skyboxStagingBufferAllocation);
 
-	vkMapMemory(device, skyboxStagingBufferMemory, 0, skyboxImageSize * 6, 0, &ddata);
+	ddata = memoryAllocator.mappedPtr(skyboxStagingBufferAllocation);
 
 	offset = 0;
 	pOffset = ddata;
@@ -2180,7 +3279,6 @@ void Renderer::createSkyboxTextureImage() {
 	pOffset = (unsigned char*)ddata + offset;
 	memcpy(pOffset, sPixels, static_cast<size_t>(skyboxImageSize));
 
-	vkUnmapMemory(device, skyboxStagingBufferMemory);
 
 	// Cubemap creation
 	VkImageCreateInfo skyboxInfo = {};
@@ -2203,14 +3301,13 @@ void Renderer::createSkyboxTextureImage() {
 		throw std::runtime_error("Failed to create skybox image!");
 	}
 
-	memoryAllocator.allocate(&skyboxImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	skyboxImageAllocation = memoryAllocator.allocate(&skyboxImage, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
 
 	transitionImageLayout(skyboxImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, 6);
-	copyBufferToImage(skyboxStagingBuffer, skyboxImage, skyboxTexWidth, skyboxTexHeight, 6);
+	copyBufferToImage(skyboxStagingBufferAllocation->buffer, skyboxStagingBufferAllocation->offset, skyboxImage, skyboxTexWidth, skyboxTexHeight, 6);
 	transitionImageLayout(skyboxImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, 6);
 
-	vkDestroyBuffer(device, skyboxStagingBuffer, nullptr);
-	vkFreeMemory(device, skyboxStagingBufferMemory, nullptr);
+	memoryAllocator.free(skyboxStagingBufferAllocation);
 }
 
 void Renderer::createSkyboxTextureImageView() {
@@ -2334,7 +3431,11 @@ void Renderer::loadModelFromFile(Model* model) {
 		}
 
 		indices.insert(std::end(indices), std::begin(meshIndex), std::end(meshIndex));
-		model->addMesh(indexSize, meshIndex.size());
+		float aabbMin[3];
+		float aabbMax[3];
+		float boundingSphere[4];
+		computeMeshBounds(meshVertex, meshIndex, aabbMin, aabbMax, boundingSphere);
+		model->addMesh(indexSize, meshIndex.size(), aabbMin, aabbMax, boundingSphere);
 
 		indexSize += meshIndex.size();
 	}
@@ -2397,7 +3498,11 @@ void Renderer::loadModelFromList(Model* model) {
 	}
 
 	indices.insert(std::end(indices), std::begin(meshIndex), std::end(meshIndex));
-	model->addMesh(indexSize, meshIndex.size());
+	float aabbMin[3];
+	float aabbMax[3];
+	float boundingSphere[4];
+	computeMeshBounds(meshVertex, meshIndex, aabbMin, aabbMax, boundingSphere);
+	model->addMesh(indexSize, meshIndex.size(), aabbMin, aabbMax, boundingSphere);
 
 	vertices.insert(std::end(vertices), std::begin(meshVertex), std::end(meshVertex));
 	model->setVertexOffset(vertexSize);
@@ -2406,6 +3511,35 @@ void Renderer::loadModelFromList(Model* model) {
 	indexSize += meshIndex.size();
 }
 
+void Renderer::computeMeshBounds(const std::vector<Vertex>& meshVertices, const std::vector<uint32_t>& meshIndices, float* aabbMin, float* aabbMax, float* boundingSphere) {
+	if (meshIndices.empty()) {
+		std::fill(aabbMin, aabbMin + 3, 0.0f);
+		std::fill(aabbMax, aabbMax + 3, 0.0f);
+		std::fill(boundingSphere, boundingSphere + 4, 0.0f);
+		return;
+	}
+
+	// Centered on the mesh's bounding box, the radius reaches the farthest vertex
+	glm::vec3 minPos = meshVertices[meshIndices[0]].pos;
+	glm::vec3 maxPos = minPos;
+	for (uint32_t index : meshIndices) {
+		minPos = glm::min(minPos, meshVertices[index].pos);
+		maxPos = glm::max(maxPos, meshVertices[index].pos);
+	}
+	glm::vec3 center = (minPos + maxPos) * 0.5f;
+	float radius = 0.0f;
+	for (uint32_t index : meshIndices) {
+		radius = std::max(radius, glm::length(meshVertices[index].pos - center));
+	}
+
+	for (int i = 0; i < 3; i++) {
+		aabbMin[i] = minPos[i];
+		aabbMax[i] = maxPos[i];
+		boundingSphere[i] = center[i];
+	}
+	boundingSphere[3] = radius;
+}
+
 void Renderer::loadSkyboxModel() {
 	std::vector<Vertex> meshVertex;
 	std::vector<uint32_t> meshIndex;
@@ -2629,10 +3763,13 @@ void Renderer::createPBRGraphicsPipeline() {
 	colorBlending.blendConstants[2] = 0.0f;
 	colorBlending.blendConstants[3] = 0.0f;
 
+	// Buffers and shadow maps in set 0, material textures in set 1
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, materialDescriptorSetLayout };
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
 	pipelineLayoutInfo.pushConstantRangeCount = 0;
 	pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
@@ -2662,6 +3799,21 @@ void Renderer::createPBRGraphicsPipeline() {
 		throw std::runtime_error("Failed to create graphics pipeline!");
 	}
 
+	// Used after the depth pre-pass, the depth is already written so only the closest fragments are shaded
+	depthStencil.depthWriteEnable = VK_FALSE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+
+	// Own layout so each pipeline's layout is destroyed once
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &graphicsPipelineLayouts[3]) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create pipeline layout!");
+	}
+
+	pipelineInfo.layout = graphicsPipelineLayouts[3];
+
+	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipelines[3]) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create graphics pipeline!");
+	}
+
 	vkDestroyShaderModule(device, vertShaderModule, nullptr);
 	vkDestroyShaderModule(device, fragShaderModule, nullptr);
 }
@@ -2864,7 +4016,7 @@ void Renderer::createShadowsGraphicsPipeline() {
 
 	VkPipelineRasterizationStateCreateInfo rasterizer = {};
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.depthClampEnable = depthClampSupported ? VK_TRUE : VK_FALSE;
 	rasterizer.rasterizerDiscardEnable = VK_FALSE;
 	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
 	rasterizer.lineWidth = 1.0f;
@@ -2937,87 +4089,288 @@ void Renderer::createShadowsGraphicsPipeline() {
 	vkDestroyShaderModule(device, vertShaderModule, nullptr);
 }
 
-void Renderer::createVertexBuffer() {
-	VkDeviceSize bufferSize = sizeof(Vertex) * vertices.size();
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(device, stagingBufferMemory);
-
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = bufferSize;
-	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+void Renderer::createDepthPrepassGraphicsPipeline() {
+	auto vertShaderCode = readFile("shaders/depth.vert.spv");
 
-	if (vkCreateBuffer(device, &bufferInfo, nullptr, &vertexBuffer) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create vertex buffer!");
-	}
-
-	memoryAllocator.allocate(&vertexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-	copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
 
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
+	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vertShaderStageInfo.module = vertShaderModule;
+	vertShaderStageInfo.pName = "main";
 
-void Renderer::createIndexBuffer() {
-	VkDeviceSize bufferSize = sizeof(uint32_t) * indices.size();
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo };
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	// Only the positions are read from the vertices
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	VkVertexInputBindingDescription bindingDescription = Vertex::getBindingDescription();
+	auto attributeDescriptions = Vertex::getShadowsAttributeDescriptions();
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = 1;
+	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(device, stagingBufferMemory);
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = bufferSize;
-	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)swapChainExtent.width;
+	viewport.height = (float)swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
 
-	if (vkCreateBuffer(device, &bufferInfo, nullptr, &indexBuffer) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create index buffer!");
-	}
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = swapChainExtent;
 
-	memoryAllocator.allocate(&indexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = &viewport;
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = &scissor;
 
-	copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+	rasterizer.depthBiasConstantFactor = 0.0f;
+	rasterizer.depthBiasClamp = 0.0f;
+	rasterizer.depthBiasSlopeFactor = 0.0f;
 
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = msaaSamples;
+	multisampling.minSampleShading = 1.0f;
+	multisampling.pSampleMask = nullptr;
+	multisampling.alphaToCoverageEnable = VK_FALSE;
+	multisampling.alphaToOneEnable = VK_FALSE;
 
-void Renderer::updateDescriptorSets(Object* obj, int frame) {
+	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.minDepthBounds = 0.0f;
+	depthStencil.maxDepthBounds = 1.0f;
+	depthStencil.stencilTestEnable = VK_FALSE;
+	depthStencil.front = {};
+	depthStencil.back = {};
+
+	// The main render pass has a color attachment, nothing is written to it
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask = 0;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+	colorBlending.blendConstants[0] = 0.0f;
+	colorBlending.blendConstants[1] = 0.0f;
+	colorBlending.blendConstants[2] = 0.0f;
+	colorBlending.blendConstants[3] = 0.0f;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 0;
+	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &graphicsPipelineLayouts[4]) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth pre-pass pipeline layout!");
+	}
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 1;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = nullptr;
+	pipelineInfo.layout = graphicsPipelineLayouts[4];
+	pipelineInfo.renderPass = renderPass;
+	pipelineInfo.subpass = 0;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipelines[4]) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth pre-pass graphics pipeline!");
+	}
+
+	vkDestroyShaderModule(device, vertShaderModule, nullptr);
+}
+
+void Renderer::createCullingPipeline() {
+	auto compShaderCode = readFile("shaders/culling.comp.spv");
+
+	VkShaderModule compShaderModule = createShaderModule(compShaderCode);
+
+	VkPipelineShaderStageCreateInfo compShaderStageInfo = {};
+	compShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	compShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	compShaderStageInfo.module = compShaderModule;
+	compShaderStageInfo.pName = "main";
+
+	// Step of the pass : 0 culls the instances, 1 writes the draw commands, then the first view and the number of views culled
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = 3 * sizeof(uint32_t);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &cullingDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullingPipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create culling pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = compShaderStageInfo;
+	pipelineInfo.layout = cullingPipelineLayout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &cullingPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create culling compute pipeline!");
+	}
+
+	vkDestroyShaderModule(device, compShaderModule, nullptr);
+}
+
+void Renderer::createDepthPyramidPipelines() {
+	// The first level reads the depth image, multisampled when the color image is
+	auto depthShaderCode = readFile(msaaSamples == VK_SAMPLE_COUNT_1_BIT ? "shaders/depthPyramidDepth.comp.spv" : "shaders/depthPyramidDepthMultisample.comp.spv");
+	auto levelShaderCode = readFile("shaders/depthPyramid.comp.spv");
+
+	VkShaderModule depthShaderModule = createShaderModule(depthShaderCode);
+	VkShaderModule levelShaderModule = createShaderModule(levelShaderCode);
+
+	// Samples of the depth image
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(int32_t);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &depthPyramidDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &depthPyramidPipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth pyramid pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = depthShaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = depthPyramidPipelineLayout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &depthPyramidDepthPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth pyramid depth compute pipeline!");
+	}
+
+	pipelineInfo.stage.module = levelShaderModule;
+
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &depthPyramidPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create depth pyramid compute pipeline!");
+	}
+
+	vkDestroyShaderModule(device, depthShaderModule, nullptr);
+	vkDestroyShaderModule(device, levelShaderModule, nullptr);
+}
+
+void Renderer::createVertexBuffer() {
+	VkDeviceSize bufferSize = sizeof(Vertex) * vertices.size();
+
+	Allocation* stagingBufferAllocation;
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBufferAllocation);
+
+	void* data = memoryAllocator.mappedPtr(stagingBufferAllocation);
+	memcpy(data, vertices.data(), (size_t)bufferSize);
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBufferAllocation);
+
+	copyBuffer(stagingBufferAllocation->buffer, stagingBufferAllocation->offset, vertexBufferAllocation->buffer, vertexBufferAllocation->offset, bufferSize);
+
+	memoryAllocator.free(stagingBufferAllocation);
+}
+
+void Renderer::createIndexBuffer() {
+	VkDeviceSize bufferSize = sizeof(uint32_t) * indices.size();
+
+	Allocation* stagingBufferAllocation;
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBufferAllocation);
+
+	void* data = memoryAllocator.mappedPtr(stagingBufferAllocation);
+	memcpy(data, indices.data(), (size_t)bufferSize);
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBufferAllocation);
+
+	copyBuffer(stagingBufferAllocation->buffer, stagingBufferAllocation->offset, indexBufferAllocation->buffer, indexBufferAllocation->offset, bufferSize);
+
+	memoryAllocator.free(stagingBufferAllocation);
+}
+
+void Renderer::updateDescriptorSets(uint32_t frame) {
 	VkDescriptorBufferInfo objectInfo = {};
-	objectInfo.buffer = obj->getObjectBuffers()->at(frame);
-	objectInfo.offset = 0;
-	objectInfo.range = sizeof(ObjectBufferObject);
+	objectInfo.buffer = objectBufferAllocation->buffer;
+	objectInfo.offset = objectBufferAllocation->offset;
+	objectInfo.range = objectBufferFrameSize;
 
 	VkDescriptorBufferInfo cameraInfo = {};
-	cameraInfo.buffer = cameraBuffers[frame];
+	cameraInfo.buffer = memoryAllocator.getRingBuffer();
 	cameraInfo.offset = 0;
 	cameraInfo.range = sizeof(CameraBufferObject);
 
 	VkDescriptorBufferInfo lightsInfo = {};
-	lightsInfo.buffer = lightsBuffers[frame];
+	lightsInfo.buffer = memoryAllocator.getRingBuffer();
 	lightsInfo.offset = 0;
 	lightsInfo.range = sizeof(LightsBufferObject);
 
 	VkDescriptorBufferInfo shadowsInfo = {};
-	shadowsInfo.buffer = shadowsBuffers[frame];
+	shadowsInfo.buffer = memoryAllocator.getRingBuffer();
 	shadowsInfo.offset = 0;
 	shadowsInfo.range = sizeof(ShadowsBufferObject);
 
+	VkDescriptorBufferInfo instanceInfo = {};
+	instanceInfo.buffer = instanceBufferAllocation->buffer;
+	instanceInfo.offset = instanceBufferAllocation->offset;
+	instanceInfo.range = instanceBufferFrameSize;
+
 	std::vector<VkDescriptorImageInfo> shadowsImageInfos;
 	shadowsImageInfos.resize(scene->getDirectionalLights().size() + scene->getSpotLights().size());
 	for (int i = 0; i < scene->getDirectionalLights().size() + scene->getSpotLights().size(); i++) {
@@ -3027,119 +4380,133 @@ void Renderer::updateDescriptorSets(Object* obj, int frame) {
 		shadowsImageInfos[i].sampler = shadowsSampler;
 	}
 
+	std::array<VkWriteDescriptorSet, 6> descriptorWrites = {};
+
+	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[0].dstSet = descriptorSets[frame];
+	descriptorWrites[0].dstBinding = 0;
+	descriptorWrites[0].dstArrayElement = 0;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	descriptorWrites[0].descriptorCount = 1;
+	descriptorWrites[0].pBufferInfo = &objectInfo;
+
+	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[1].dstSet = descriptorSets[frame];
+	descriptorWrites[1].dstBinding = 1;
+	descriptorWrites[1].dstArrayElement = 0;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrites[1].descriptorCount = 1;
+	descriptorWrites[1].pBufferInfo = &cameraInfo;
+
+	descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[2].dstSet = descriptorSets[frame];
+	descriptorWrites[2].dstBinding = 2;
+	descriptorWrites[2].dstArrayElement = 0;
+	descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrites[2].descriptorCount = 1;
+	descriptorWrites[2].pBufferInfo = &lightsInfo;
+
+	descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[3].dstSet = descriptorSets[frame];
+	descriptorWrites[3].dstBinding = 3;
+	descriptorWrites[3].dstArrayElement = 0;
+	descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrites[3].descriptorCount = 1;
+	descriptorWrites[3].pBufferInfo = &shadowsInfo;
+
+	descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[4].dstSet = descriptorSets[frame];
+	descriptorWrites[4].dstBinding = 4;
+	descriptorWrites[4].dstArrayElement = 0;
+	descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[4].descriptorCount = static_cast<uint32_t>(shadowsImageInfos.size());
+	descriptorWrites[4].pImageInfo = shadowsImageInfos.data();
+
+	descriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[5].dstSet = descriptorSets[frame];
+	descriptorWrites[5].dstBinding = 5;
+	descriptorWrites[5].dstArrayElement = 0;
+	descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	descriptorWrites[5].descriptorCount = 1;
+	descriptorWrites[5].pBufferInfo = &instanceInfo;
+
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void Renderer::updateMaterialDescriptorSets(Material* mat, uint32_t frame) {
 	VkDescriptorImageInfo diffuseImageInfo = {};
 	diffuseImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	diffuseImageInfo.imageView = *obj->getMaterial()->getDiffuseTextureImageView();
-	diffuseImageInfo.sampler = *obj->getMaterial()->getDiffuseTextureSampler();
+	diffuseImageInfo.imageView = *mat->getDiffuseTextureImageView();
+	diffuseImageInfo.sampler = *mat->getDiffuseTextureSampler();
 
 	VkDescriptorImageInfo normalImageInfo = {};
 	normalImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	normalImageInfo.imageView = *obj->getMaterial()->getNormalTextureImageView();
-	normalImageInfo.sampler = *obj->getMaterial()->getNormalTextureSampler();
+	normalImageInfo.imageView = *mat->getNormalTextureImageView();
+	normalImageInfo.sampler = *mat->getNormalTextureSampler();
 
 	VkDescriptorImageInfo metallicImageInfo = {};
 	metallicImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	metallicImageInfo.imageView = *obj->getMaterial()->getMetallicTextureImageView();
-	metallicImageInfo.sampler = *obj->getMaterial()->getMetallicTextureSampler();
+	metallicImageInfo.imageView = *mat->getMetallicTextureImageView();
+	metallicImageInfo.sampler = *mat->getMetallicTextureSampler();
 
 	VkDescriptorImageInfo roughnessImageInfo = {};
 	roughnessImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	roughnessImageInfo.imageView = *obj->getMaterial()->getRoughnessTextureImageView();
-	roughnessImageInfo.sampler = *obj->getMaterial()->getRoughnessTextureSampler();
+	roughnessImageInfo.imageView = *mat->getRoughnessTextureImageView();
+	roughnessImageInfo.sampler = *mat->getRoughnessTextureSampler();
 
 	VkDescriptorImageInfo AOImageInfo = {};
 	AOImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	AOImageInfo.imageView = *obj->getMaterial()->getAOTextureImageView();
-	AOImageInfo.sampler = *obj->getMaterial()->getAOTextureSampler();
+	AOImageInfo.imageView = *mat->getAOTextureImageView();
+	AOImageInfo.sampler = *mat->getAOTextureSampler();
 
-	std::array<VkWriteDescriptorSet, 10> descriptorWrites = {};
+	std::array<VkWriteDescriptorSet, 5> descriptorWrites = {};
 
 	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[0].dstSet = obj->getDescriptorSets()->at(frame);
+	descriptorWrites[0].dstSet = *mat->getDescriptorSet(frame);
 	descriptorWrites[0].dstBinding = 0;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	descriptorWrites[0].descriptorCount = 1;
-	descriptorWrites[0].pBufferInfo = &objectInfo;
+	descriptorWrites[0].pImageInfo = &diffuseImageInfo;
 
 	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[1].dstSet = obj->getDescriptorSets()->at(frame);
+	descriptorWrites[1].dstSet = *mat->getDescriptorSet(frame);
 	descriptorWrites[1].dstBinding = 1;
 	descriptorWrites[1].dstArrayElement = 0;
-	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	descriptorWrites[1].descriptorCount = 1;
-	descriptorWrites[1].pBufferInfo = &cameraInfo;
+	descriptorWrites[1].pImageInfo = &normalImageInfo;
 
 	descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[2].dstSet = obj->getDescriptorSets()->at(frame);
+	descriptorWrites[2].dstSet = *mat->getDescriptorSet(frame);
 	descriptorWrites[2].dstBinding = 2;
 	descriptorWrites[2].dstArrayElement = 0;
-	descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	descriptorWrites[2].descriptorCount = 1;
-	descriptorWrites[2].pBufferInfo = &lightsInfo;
+	descriptorWrites[2].pImageInfo = &metallicImageInfo;
 
 	descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[3].dstSet = obj->getDescriptorSets()->at(frame);
+	descriptorWrites[3].dstSet = *mat->getDescriptorSet(frame);
 	descriptorWrites[3].dstBinding = 3;
 	descriptorWrites[3].dstArrayElement = 0;
-	descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	descriptorWrites[3].descriptorCount = 1;
-	descriptorWrites[3].pBufferInfo = &shadowsInfo;
+	descriptorWrites[3].pImageInfo = &roughnessImageInfo;
 
 	descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[4].dstSet = obj->getDescriptorSets()->at(frame);
+	descriptorWrites[4].dstSet = *mat->getDescriptorSet(frame);
 	descriptorWrites[4].dstBinding = 4;
 	descriptorWrites[4].dstArrayElement = 0;
 	descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	descriptorWrites[4].descriptorCount = static_cast<uint32_t>(shadowsImageInfos.size());
-	descriptorWrites[4].pImageInfo = shadowsImageInfos.data();
-
-	descriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[5].dstSet = obj->getDescriptorSets()->at(frame);
-	descriptorWrites[5].dstBinding = 5;
-	descriptorWrites[5].dstArrayElement = 0;
-	descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	descriptorWrites[5].descriptorCount = 1;
-	descriptorWrites[5].pImageInfo = &diffuseImageInfo;
-
-	descriptorWrites[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[6].dstSet = obj->getDescriptorSets()->at(frame);
-	descriptorWrites[6].dstBinding = 6;
-	descriptorWrites[6].dstArrayElement = 0;
-	descriptorWrites[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	descriptorWrites[6].descriptorCount = 1;
-	descriptorWrites[6].pImageInfo = &normalImageInfo;
-
-	descriptorWrites[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[7].dstSet = obj->getDescriptorSets()->at(frame);
-	descriptorWrites[7].dstBinding = 7;
-	descriptorWrites[7].dstArrayElement = 0;
-	descriptorWrites[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	descriptorWrites[7].descriptorCount = 1;
-	descriptorWrites[7].pImageInfo = &metallicImageInfo;
-
-	descriptorWrites[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[8].dstSet = obj->getDescriptorSets()->at(frame);
-	descriptorWrites[8].dstBinding = 8;
-	descriptorWrites[8].dstArrayElement = 0;
-	descriptorWrites[8].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	descriptorWrites[8].descriptorCount = 1;
-	descriptorWrites[8].pImageInfo = &roughnessImageInfo;
-
-	descriptorWrites[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[9].dstSet = obj->getDescriptorSets()->at(frame);
-	descriptorWrites[9].dstBinding = 9;
-	descriptorWrites[9].dstArrayElement = 0;
-	descriptorWrites[9].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	descriptorWrites[9].descriptorCount = 1;
-	descriptorWrites[9].pImageInfo = &AOImageInfo;
+	descriptorWrites[4].descriptorCount = 1;
+	descriptorWrites[4].pImageInfo = &AOImageInfo;
 
 	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
 void Renderer::updateSkyboxDescriptorSets(int frame) {
 	VkDescriptorBufferInfo cameraInfo = {};
-	cameraInfo.buffer = cameraBuffers[frame];
+	cameraInfo.buffer = memoryAllocator.getRingBuffer();
 	cameraInfo.offset = 0;
 	cameraInfo.range = sizeof(CameraBufferObject);
 
@@ -3154,7 +4521,7 @@ void Renderer::updateSkyboxDescriptorSets(int frame) {
 	descriptorWrites[0].dstSet = skyboxDescriptorSets[frame];
 	descriptorWrites[0].dstBinding = 0;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorWrites[0].descriptorCount = 1;
 	descriptorWrites[0].pBufferInfo = &cameraInfo;
 
@@ -3169,38 +4536,213 @@ void Renderer::updateSkyboxDescriptorSets(int frame) {
 	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
-void Renderer::updateShadowsDescriptorSets(Object* obj, int frame) {
+void Renderer::updateShadowsDescriptorSets(uint32_t frame) {
 	VkDescriptorBufferInfo objectInfo = {};
-	objectInfo.buffer = obj->getObjectBuffers()->at(frame);
-	objectInfo.offset = 0;
-	objectInfo.range = sizeof(ObjectBufferObject);
+	objectInfo.buffer = objectBufferAllocation->buffer;
+	objectInfo.offset = objectBufferAllocation->offset;
+	objectInfo.range = objectBufferFrameSize;
 
 	VkDescriptorBufferInfo shadowsInfo = {};
-	shadowsInfo.buffer = shadowsBuffers[frame];
+	shadowsInfo.buffer = memoryAllocator.getRingBuffer();
 	shadowsInfo.offset = 0;
 	shadowsInfo.range = sizeof(ShadowsBufferObject);
 
-	std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+	VkDescriptorBufferInfo instanceInfo = {};
+	instanceInfo.buffer = instanceBufferAllocation->buffer;
+	instanceInfo.offset = instanceBufferAllocation->offset;
+	instanceInfo.range = instanceBufferFrameSize;
+
+	std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
 
 	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[0].dstSet = obj->getShadowsDescriptorSets()->at(frame);
+	descriptorWrites[0].dstSet = shadowsDescriptorSets[frame];
 	descriptorWrites[0].dstBinding = 0;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 	descriptorWrites[0].descriptorCount = 1;
 	descriptorWrites[0].pBufferInfo = &objectInfo;
 
 	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[1].dstSet = obj->getShadowsDescriptorSets()->at(frame);
+	descriptorWrites[1].dstSet = shadowsDescriptorSets[frame];
 	descriptorWrites[1].dstBinding = 1;
 	descriptorWrites[1].dstArrayElement = 0;
-	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorWrites[1].descriptorCount = 1;
 	descriptorWrites[1].pBufferInfo = &shadowsInfo;
 
+	descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[2].dstSet = shadowsDescriptorSets[frame];
+	descriptorWrites[2].dstBinding = 2;
+	descriptorWrites[2].dstArrayElement = 0;
+	descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	descriptorWrites[2].descriptorCount = 1;
+	descriptorWrites[2].pBufferInfo = &instanceInfo;
+
 	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
+void Renderer::updateCullingDescriptorSets(uint32_t frame) {
+	// Frame's region of each buffer, the frustums are in the ring buffer
+	std::array<VkDescriptorBufferInfo, 7> bufferInfos = {};
+	bufferInfos[0] = { objectBufferAllocation->buffer, objectBufferAllocation->offset + frame * objectBufferFrameSize, objectBufferFrameSize };
+	bufferInfos[1] = { memoryAllocator.getRingBuffer(), 0, sizeof(CullingBufferObject) };
+	bufferInfos[2] = { cullingDrawBufferAllocation->buffer, cullingDrawBufferAllocation->offset + frame * cullingDrawBufferFrameSize, cullingDrawBufferFrameSize };
+	bufferInfos[3] = { cullingInstanceBufferAllocation->buffer, cullingInstanceBufferAllocation->offset + frame * cullingInstanceBufferFrameSize, cullingInstanceBufferFrameSize };
+	bufferInfos[4] = { instanceBufferAllocation->buffer, instanceBufferAllocation->offset + frame * instanceBufferFrameSize, instanceBufferFrameSize };
+	bufferInfos[5] = { indirectBufferAllocation->buffer, indirectBufferAllocation->offset + frame * indirectBufferFrameSize, indirectBufferFrameSize };
+	bufferInfos[6] = { cullingCountBufferAllocation->buffer, cullingCountBufferAllocation->offset + frame * cullingCountBufferFrameSize, cullingCountBufferFrameSize };
+
+	// Then the depth pyramid and the visibility, shared by the frames in flight
+	VkDescriptorImageInfo depthPyramidInfo = { depthPyramidSampler, depthPyramidImageView, VK_IMAGE_LAYOUT_GENERAL };
+	VkDescriptorBufferInfo visibilityInfo = { visibilityBufferAllocation->buffer, visibilityBufferAllocation->offset, visibilityBufferSize };
+
+	std::array<VkWriteDescriptorSet, 9> descriptorWrites = {};
+	for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = cullingDescriptorSets[frame];
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = i == 1 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = i < bufferInfos.size() ? &bufferInfos[i] : &visibilityInfo;
+	}
+	descriptorWrites[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[7].pBufferInfo = nullptr;
+	descriptorWrites[7].pImageInfo = &depthPyramidInfo;
+
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void Renderer::updateDepthPyramidDescriptorSets() {
+	// Each level reads the previous one, the first one reads the depth image
+	VkDescriptorImageInfo depthInfo = { depthPyramidSampler, depthImageView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+	for (uint32_t i = 0; i < depthPyramidLevels; i++) {
+		VkDescriptorImageInfo srcLevelInfo = { VK_NULL_HANDLE, depthPyramidLevelViews[i == 0 ? 0 : i - 1], VK_IMAGE_LAYOUT_GENERAL };
+		VkDescriptorImageInfo dstLevelInfo = { VK_NULL_HANDLE, depthPyramidLevelViews[i], VK_IMAGE_LAYOUT_GENERAL };
+		std::array<VkDescriptorImageInfo*, 3> imageInfos = { &depthInfo, &srcLevelInfo, &dstLevelInfo };
+
+		std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+		for (uint32_t j = 0; j < descriptorWrites.size(); j++) {
+			descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[j].dstSet = depthPyramidDescriptorSets[i];
+			descriptorWrites[j].dstBinding = j;
+			descriptorWrites[j].dstArrayElement = 0;
+			descriptorWrites[j].descriptorType = j == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			descriptorWrites[j].descriptorCount = 1;
+			descriptorWrites[j].pImageInfo = imageInfos[j];
+		}
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	}
+}
+
+void Renderer::defragmentMemory(VkCommandBuffer commandBuffer) {
+	uint32_t frame = static_cast<uint32_t>(currentFrame);
+
+	// The frame's fence signaled so the previous places of the resources it moved are not used anymore
+	for (VkImageView imageView : movedImageViews[frame]) {
+		vkDestroyImageView(device, imageView, nullptr);
+	}
+	movedImageViews[frame].clear();
+	memoryAllocator.finishDefragmentation(frame);
+
+	if (memoryAllocator.needsDefragmentation()) {
+		// The copies are executed at the beginning of this frame
+		std::vector<Allocation*> movedAllocations;
+		memoryAllocator.defragment(commandBuffer, DEFRAGMENTATION_MAX_BYTES_PER_FRAME, frame, movedAllocations);
+
+		if (!movedAllocations.empty()) {
+			auto isMoved = [&movedAllocations](Allocation* allocation) {
+				return std::find(movedAllocations.begin(), movedAllocations.end(), allocation) != movedAllocations.end();
+			};
+			bool buffersMoved = isMoved(objectBufferAllocation) || isMoved(instanceBufferAllocation) || isMoved(indirectBufferAllocation) || isMoved(cullingDrawBufferAllocation) || isMoved(cullingInstanceBufferAllocation) || isMoved(cullingCountBufferAllocation) || isMoved(visibilityBufferAllocation);
+			bool geometryMoved = isMoved(vertexBufferAllocation) || isMoved(indexBufferAllocation);
+
+			// Moved textures have a new image, the views of the previous ones are destroyed with them
+			std::vector<Material*> movedMaterials;
+			for (Material* mat : materials) {
+				if (updateMovedTextures(mat, frame)) {
+					movedMaterials.push_back(mat);
+				}
+			}
+
+			// Every frame in flight updates its descriptor sets when it begins
+			for (MovedResources& frameMovedResources : movedResources) {
+				frameMovedResources.buffers = frameMovedResources.buffers || buffersMoved;
+				frameMovedResources.geometry = frameMovedResources.geometry || geometryMoved;
+				for (Material* mat : movedMaterials) {
+					if (std::find(frameMovedResources.materials.begin(), frameMovedResources.materials.end(), mat) == frameMovedResources.materials.end()) {
+						frameMovedResources.materials.push_back(mat);
+					}
+				}
+			}
+		}
+	}
+
+	// Only the descriptor sets of the moved resources are rewritten
+	MovedResources& frameMovedResources = movedResources[frame];
+	if (frameMovedResources.buffers) {
+		updateDescriptorSets(frame);
+		updateShadowsDescriptorSets(frame);
+		updateCullingDescriptorSets(frame);
+	}
+	for (Material* mat : frameMovedResources.materials) {
+		updateMaterialDescriptorSets(mat, frame);
+	}
+
+	// Updated descriptor sets and moved vertex and index buffers invalidate the frame's recorded commands
+	if (frameMovedResources.buffers || frameMovedResources.geometry || !frameMovedResources.materials.empty()) {
+		recordedCommands[frame].valid = false;
+	}
+	frameMovedResources = MovedResources();
+}
+
+bool Renderer::updateMovedTextures(Material* mat, uint32_t frame) {
+	bool moved = false;
+
+	// Diffuse Texture
+	if (*mat->getDiffuseTextureImage() != (*mat->getDiffuseTextureAllocation())->image) {
+		movedImageViews[frame].push_back(*mat->getDiffuseTextureImageView());
+		mat->setDiffuseTextureImage((*mat->getDiffuseTextureAllocation())->image);
+		mat->setDiffuseTextureImageView(createImageView(*mat->getDiffuseTextureImage(), VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mat->getDiffuseMipLevel()));
+		moved = true;
+	}
+
+	// Normal Texture
+	if (*mat->getNormalTextureImage() != (*mat->getNormalTextureAllocation())->image) {
+		movedImageViews[frame].push_back(*mat->getNormalTextureImageView());
+		mat->setNormalTextureImage((*mat->getNormalTextureAllocation())->image);
+		mat->setNormalTextureImageView(createImageView(*mat->getNormalTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, mat->getNormalMipLevel()));
+		moved = true;
+	}
+
+	// Metallic Texture
+	if (*mat->getMetallicTextureImage() != (*mat->getMetallicTextureAllocation())->image) {
+		movedImageViews[frame].push_back(*mat->getMetallicTextureImageView());
+		mat->setMetallicTextureImage((*mat->getMetallicTextureAllocation())->image);
+		mat->setMetallicTextureImageView(createImageView(*mat->getMetallicTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, mat->getMetallicMipLevel()));
+		moved = true;
+	}
+
+	// Roughness Texture
+	if (*mat->getRoughnessTextureImage() != (*mat->getRoughnessTextureAllocation())->image) {
+		movedImageViews[frame].push_back(*mat->getRoughnessTextureImageView());
+		mat->setRoughnessTextureImage((*mat->getRoughnessTextureAllocation())->image);
+		mat->setRoughnessTextureImageView(createImageView(*mat->getRoughnessTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, mat->getRoughnessMipLevel()));
+		moved = true;
+	}
+
+	// AO Texture
+	if (*mat->getAOTextureImage() != (*mat->getAOTextureAllocation())->image) {
+		movedImageViews[frame].push_back(*mat->getAOTextureImageView());
+		mat->setAOTextureImage((*mat->getAOTextureAllocation())->image);
+		mat->setAOTextureImageView(createImageView(*mat->getAOTextureImage(), VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, mat->getAOMipLevel()));
+		moved = true;
+	}
+
+	return moved;
+}
+
 void Renderer::mainLoop() {
 	while (!glfwWindowShouldClose(window)) {
 		glfwPollEvents();
@@ -3213,6 +4755,7 @@ void Renderer::mainLoop() {
 
 void Renderer::drawFrame() {
 	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	memoryAllocator.beginFrame(static_cast<uint32_t>(currentFrame));
 
 	uint32_t imageIndex;
 	VkResult result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -3225,79 +4768,16 @@ void Renderer::drawFrame() {
 		throw std::runtime_error("Failed to acquire swap chain image!");
 	}
 
-	recordRenderingCommandBuffer(imageIndex);
-
-	for (Object* obj : scene->getElements()) {
-		updateUniformBuffer(obj, imageIndex);
-	}
-
-	void* data;
+	// Camera, lights and shadows are written in the ring buffer before recording as their offsets are needed
+	updateFrameBuffers();
 
-	// Camera
-	Camera* camera = scene->getCamera();
-	CameraBufferObject cbo = {};
-	cbo.view = glm::lookAt(glm::vec3(camera->getPositionX(), camera->getPositionY(), camera->getPositionZ()), glm::vec3(camera->getPositionX() + camera->getFrontX(), camera->getPositionY() + camera->getFrontY(), camera->getPositionZ() + camera->getFrontZ()), glm::vec3(camera->getUpX(), camera->getUpY(), camera->getUpZ()));
-	cbo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 1000.0f);
-	cbo.proj[1][1] *= -1;
-	cbo.pos = glm::vec3(camera->getPositionX(), camera->getPositionY(), camera->getPositionZ());
-
-	vkMapMemory(device, cameraBuffersMemory[imageIndex], 0, sizeof(cbo), 0, &data);
-	memcpy(data, &cbo, sizeof(cbo));
-	vkUnmapMemory(device, cameraBuffersMemory[imageIndex]);
-
-	// Lights
-	LightsBufferObject lbo = {};
-	std::vector<DirectionalLight*> dirLights = scene->getDirectionalLights();
-	std::vector<PointLight*> pointLights = scene->getPointLights();
-	std::vector<SpotLight*> spotLights = scene->getSpotLights();
-	lbo.numLights.x = (float)dirLights.size();
-	lbo.numLights.y = (float)pointLights.size();
-	lbo.numLights.z = (float)spotLights.size();
-	for (size_t i = 0; i < dirLights.size(); i++) {
-		lbo.dirLightsDir[i] = glm::vec4(dirLights[i]->getDirectionX(), dirLights[i]->getDirectionY(), dirLights[i]->getDirectionZ(), 0.0f);
-		lbo.dirLightsColor[i] = glm::vec4(dirLights[i]->getColorR(), dirLights[i]->getColorG(), dirLights[i]->getColorB(), 0.0f);
-	}
-	for (size_t i = 0; i < pointLights.size(); i++) {
-		lbo.pointLightsPos[i] = glm::vec4(pointLights[i]->getPositionX(), pointLights[i]->getPositionY(), pointLights[i]->getPositionZ(), 0.0f);
-		lbo.pointLightsColor[i] = glm::vec4(pointLights[i]->getColorR(), pointLights[i]->getColorG(), pointLights[i]->getColorB(), 0.0f);
-	}
-	for (size_t i = 0; i < spotLights.size(); i++) {
-		lbo.spotLightsPos[i] = glm::vec4(spotLights[i]->getPositionX(), spotLights[i]->getPositionY(), spotLights[i]->getPositionZ(), 0.0f);
-		lbo.spotLightsDir[i] = glm::vec4(spotLights[i]->getDirectionX(), spotLights[i]->getDirectionY(), spotLights[i]->getDirectionZ(), 0.0f);
-		lbo.spotLightsColor[i] = glm::vec4(spotLights[i]->getColorR(), spotLights[i]->getColorG(), spotLights[i]->getColorB(), 0.0f);
-		lbo.spotLightsCutoffs[i] = glm::vec2(spotLights[i]->getCutoff(), spotLights[i]->getOutCutoff());
-	}
+	// The frame's fence signaled so its region of the instances buffer can be rewritten
+	updateDrawList(static_cast<uint32_t>(currentFrame));
 
-	vkMapMemory(device, lightsBuffersMemory[imageIndex], 0, sizeof(lbo), 0, &data);
-	memcpy(data, &lbo, sizeof(lbo));
-	vkUnmapMemory(device, lightsBuffersMemory[imageIndex]);
-
-	// Shadows
-	ShadowsBufferObject sbo = {};
-	sbo.numLights.x = (float)dirLights.size();
-	sbo.numLights.y = (float)pointLights.size();
-	sbo.numLights.z = (float)spotLights.size();
-	glm::vec3 eye;
-	glm::vec3 up;
-	glm::mat4 shadowsView;
-	glm::mat4 shadowsProj = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -10.0f, 20.0f);
-	for (int i = 0; i < dirLights.size(); i++) {
-		eye = glm::vec3(-dirLights[i]->getDirectionX(), -dirLights[i]->getDirectionY(), -dirLights[i]->getDirectionZ());
-		up = glm::dot(glm::vec3(0.0f, 1.0f, 0.0f), eye) == (glm::length(glm::vec3(0.0f, 1.0f, 0.0f)) * glm::length(eye)) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
-		shadowsView = glm::lookAt(eye, glm::vec3(0.0f), up);
-		sbo.dirLightsSpace[i] = shadowsProj * shadowsView;
-	}
-	for (int i = 0; i < spotLights.size(); i++) {
-		shadowsProj = glm::perspective(glm::radians(120.0f), SHADOWMAP_WIDTH / (float)SHADOWMAP_HEIGHT, 0.1f, 20.0f);
-		eye = glm::vec3(spotLights[i]->getPositionX(), spotLights[i]->getPositionY(), spotLights[i]->getPositionZ());
-		up = glm::dot(glm::vec3(0.0f, 1.0f, 0.0f), eye) == (glm::length(glm::vec3(0.0f, 1.0f, 0.0f)) * glm::length(eye)) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
-		shadowsView = glm::lookAt(eye, glm::vec3(spotLights[i]->getPositionX() + spotLights[i]->getDirectionX(), spotLights[i]->getPositionY() + spotLights[i]->getDirectionY(), spotLights[i]->getPositionZ() + spotLights[i]->getDirectionZ()), up);
-		sbo.spotLightsSpace[i] = shadowsProj * shadowsView;
-	}
+	recordRenderingCommandBuffer(imageIndex);
 
-	vkMapMemory(device, shadowsBuffersMemory[imageIndex], 0, sizeof(sbo), 0, &data);
-	memcpy(data, &sbo, sizeof(sbo));
-	vkUnmapMemory(device, shadowsBuffersMemory[imageIndex]);
+	// The frame's fence signaled so its region of the objects buffer is not used anymore
+	updateObjectBuffer(static_cast<uint32_t>(currentFrame));
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -3343,34 +4823,49 @@ void Renderer::drawFrame() {
 }
 
 void Renderer::cleanup() {
+	// Memory statistics of the scene, before anything is released
+	memoryAllocator.dumpStats(MEMORY_STATS_PATH);
+
 	if (enableValidationLayers) {
 		DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 	}
 
 	cleanupSwapChain();
 
+	// Views of the previous images of the textures moved by the last frames
+	for (std::vector<VkImageView>& frameMovedImageViews : movedImageViews) {
+		for (VkImageView imageView : frameMovedImageViews) {
+			vkDestroyImageView(device, imageView, nullptr);
+		}
+	}
+
 	for (Object* obj : scene->getElements()) {
 		Material* mat = obj->getMaterial();
 		if (!mat->isDestructed()) {
 			vkDestroySampler(device, *mat->getDiffuseTextureSampler(), nullptr);
 			vkDestroyImageView(device, *mat->getDiffuseTextureImageView(), nullptr);
 			vkDestroyImage(device, *mat->getDiffuseTextureImage(), nullptr);
+			memoryAllocator.free(*mat->getDiffuseTextureAllocation());
 
 			vkDestroySampler(device, *mat->getNormalTextureSampler(), nullptr);
 			vkDestroyImageView(device, *mat->getNormalTextureImageView(), nullptr);
 			vkDestroyImage(device, *mat->getNormalTextureImage(), nullptr);
+			memoryAllocator.free(*mat->getNormalTextureAllocation());
 
 			vkDestroySampler(device, *mat->getMetallicTextureSampler(), nullptr);
 			vkDestroyImageView(device, *mat->getMetallicTextureImageView(), nullptr);
 			vkDestroyImage(device, *mat->getMetallicTextureImage(), nullptr);
+			memoryAllocator.free(*mat->getMetallicTextureAllocation());
 
 			vkDestroySampler(device, *mat->getRoughnessTextureSampler(), nullptr);
 			vkDestroyImageView(device, *mat->getRoughnessTextureImageView(), nullptr);
 			vkDestroyImage(device, *mat->getRoughnessTextureImage(), nullptr);
+			memoryAllocator.free(*mat->getRoughnessTextureAllocation());
 
 			vkDestroySampler(device, *mat->getAOTextureSampler(), nullptr);
 			vkDestroyImageView(device, *mat->getAOTextureImageView(), nullptr);
 			vkDestroyImage(device, *mat->getAOTextureImage(), nullptr);
+			memoryAllocator.free(*mat->getAOTextureAllocation());
 
 			mat->destructedTrue();
 		}
@@ -3379,15 +4874,27 @@ void Renderer::cleanup() {
 	vkDestroySampler(device, skyboxSampler, nullptr);
 	vkDestroyImageView(device, skyboxImageView, nullptr);
 	vkDestroyImage(device, skyboxImage, nullptr);
+	memoryAllocator.free(skyboxImageAllocation);
 
 	vkDestroySampler(device, shadowsSampler, nullptr);
+	vkDestroySampler(device, depthPyramidSampler, nullptr);
 
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, materialDescriptorSetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(device, skyboxDescriptorSetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(device, shadowsDescriptorSetLayout, nullptr);
 
-	vkDestroyBuffer(device, vertexBuffer, nullptr);
-	vkDestroyBuffer(device, indexBuffer, nullptr);
+	vkDestroyPipeline(device, cullingPipeline, nullptr);
+	vkDestroyPipelineLayout(device, cullingPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, cullingDescriptorSetLayout, nullptr);
+
+	vkDestroyPipeline(device, depthPyramidDepthPipeline, nullptr);
+	vkDestroyPipeline(device, depthPyramidPipeline, nullptr);
+	vkDestroyPipelineLayout(device, depthPyramidPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, depthPyramidDescriptorSetLayout, nullptr);
+
+	memoryAllocator.free(vertexBufferAllocation);
+	memoryAllocator.free(indexBufferAllocation);
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
@@ -3395,11 +4902,20 @@ void Renderer::cleanup() {
 	}
 
 	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		vkDestroyCommandPool(device, renderingCommandPools[i], nullptr);
+		vkDestroyCommandPool(device, renderingCommandPools[i].commandPool, nullptr);
 		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
 	}
+	for (RecordedCommands& frameCommands : recordedCommands) {
+		for (RecordingCommandPool& recordingCommandPool : frameCommands.commandPools) {
+			vkDestroyCommandPool(device, recordingCommandPool.commandPool, nullptr);
+		}
+	}
+	recordingThreads.stop();
 
 	vkDestroyCommandPool(device, singleTimeCommandPool, nullptr);
+
+	memoryAllocator.free();
+
 	vkDestroyDevice(device, nullptr);
 	vkDestroySurfaceKHR(instance, surface, nullptr);
 	vkDestroyInstance(instance, nullptr);
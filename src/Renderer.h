@@ -22,12 +22,35 @@
 #include <unordered_map>
 #include "Scene.h"
 #include "MemoryAllocator.h"
+#include "VulkanMemoryBackend.h"
+#include "FrustumCuller.h"
+#include "ThreadPool.h"
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
+// Per frame in flight size of the ring buffer holding the camera, lights and shadows data
+const VkDeviceSize RING_BUFFER_FRAME_SIZE = 65536;
+// Maximum amount of memory moved by the defragmentation each frame
+const VkDeviceSize DEFRAGMENTATION_MAX_BYTES_PER_FRAME = 8388608;
+// Memory allocator statistics, written when pressing F12 and at exit
+const std::string MEMORY_STATS_PATH = "memory_stats.json";
+// Memory allocations trace, recorded when built with ONIENGINE_MEMORY_TRACE
+const std::string MEMORY_TRACE_PATH = "memory_trace.txt";
 
 const int SHADOWMAP_WIDTH = 2048;
 const int SHADOWMAP_HEIGHT = 2048;
 
+// Views culled by the culling pass, the camera then every directional and spot light
+const int MAX_CULLING_VIEWS = 21;
+// Threads of a culling pass workgroup, same as local_size_x in culling.comp
+const uint32_t CULLING_WORKGROUP_SIZE = 64;
+// Threads of a depth pyramid workgroup in each dimension, same as local_size_x and local_size_y in the depthPyramid shaders
+const uint32_t DEPTH_PYRAMID_WORKGROUP_SIZE = 8;
+
+// Threads recording the rendering command buffers, the main thread included
+const uint32_t MAX_RECORDING_THREADS = 8;
+// Minimum number of draw groups or indirect batches recorded by a slice of the main pass
+const uint32_t MIN_RECORDING_SLICE_SIZE = 64;
+
 const std::vector<const char*> validationLayers = {
 	"VK_LAYER_KHRONOS_validation",
 	"VK_LAYER_LUNARG_monitor"
@@ -43,8 +66,12 @@ const bool enableValidationLayers = false;
 const bool enableValidationLayers = true;
 #endif
 
+// Record of an object in the objects storage buffer, the shaders read it with the instance index
 struct ObjectBufferObject {
 	alignas(16) glm::mat4 model;
+	// Inverse transpose of the model matrix, mat4 as a mat3's columns are padded to vec4 in the buffer
+	alignas(16) glm::mat4 normal;
+	alignas(16) uint32_t materialIndex;
 };
 
 struct CameraBufferObject {
@@ -59,6 +86,94 @@ struct ShadowsBufferObject {
 	alignas(16) glm::mat4 spotLightsSpace[10];
 };
 
+// Frustum planes of each view, the culling pass tests the meshes' bounding spheres against them
+struct CullingBufferObject {
+	alignas(16) glm::vec4 frustumPlanes[MAX_CULLING_VIEWS * 6];
+	// Camera's view and projection, projects the objects on the depth pyramid
+	alignas(16) glm::mat4 viewProj;
+	// Views, the last one being the second phase of the occlusion culling, draws, instances and whether the draws are compacted for vkCmdDrawIndexedIndirectCount
+	alignas(16) glm::uvec4 counts;
+	// Depth pyramid's width, height and levels then the occlusion culling flags
+	alignas(16) glm::uvec4 occlusion;
+};
+
+// Flags of the occlusion culling, same as in culling.comp
+const uint32_t OCCLUSION_PARITY = 1;
+const uint32_t OCCLUSION_ENABLED = 2;
+
+// Mesh of a draw group given to the culling pass, which writes its draw command for each view
+struct CullingDraw {
+	alignas(16) glm::vec4 boundingSphere;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	// Place of the draw's instances in each view's part of the instances buffer
+	uint32_t firstInstance;
+	// Batch of the draw in the main pass and its first draw, the draws of a batch are compacted together
+	uint32_t batch;
+	uint32_t batchFirstDraw;
+	uint32_t padding[2];
+};
+
+// Object drawn by a culling draw
+struct CullingInstance {
+	uint32_t draw;
+	uint32_t object;
+};
+
+// Object of the draw list, sorted by pipeline, material, model then front-to-back depth
+struct DrawItem {
+	uint64_t key;
+	Object* object;
+};
+
+// Indirect draws using the same pipeline and material, submitted with one multi-draw
+struct IndirectBatch {
+	int graphicsPipelineIndex;
+	Material* material;
+	uint32_t firstDraw;
+	uint32_t drawCount;
+};
+
+// Objects sharing their model, material and pipeline, drawn with one instanced draw per mesh
+struct DrawGroup {
+	Model* model;
+	Material* material;
+	int graphicsPipelineIndex;
+	std::vector<Object*> objects;
+	// Instance index of the group's first object, the instances buffer gives each instance's object
+	uint32_t firstInstance;
+};
+
+// Command pool and the secondary command buffers allocated from it, reused after the pool is reset
+struct RecordingCommandPool {
+	VkCommandPool commandPool;
+	std::vector<VkCommandBuffer> secondaryCommandBuffers;
+	uint32_t usedSecondaryCommandBuffers;
+};
+
+// Secondary command buffers of the shadow passes then of the main pass' slices for a frame in flight, reused until the draws change
+struct RecordedCommands {
+	// One pool per recording thread
+	std::vector<RecordingCommandPool> commandPools;
+	std::vector<VkCommandBuffer> secondaryCommandBuffers;
+	uint32_t shadowsPassCount;
+	uint32_t objectsSliceCount;
+	// Slices of the objects found visible by the occlusion culling, drawn after the depth pyramid is built
+	uint32_t occlusionSliceCount;
+	uint64_t drawStateHash;
+	bool valid;
+};
+
+// Resources moved by the defragmentation that a frame in flight's descriptor sets and recorded commands still refer to
+struct MovedResources {
+	// Buffers read through the descriptor sets
+	bool buffers = false;
+	// Vertex and index buffers, bound in the recorded commands
+	bool geometry = false;
+	std::vector<Material*> materials;
+};
+
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
@@ -165,6 +280,14 @@ public:
 	void setScene(Scene* newScene);
 	void setFullscreen(bool newIsFullscreen);
 	void setResolution(int newWidth, int newHeight);
+	// Draws are read from an indirect buffer instead of being recorded one by one
+	void setIndirectDraw(bool newIndirectDraw);
+	// Objects hidden behind the ones drawn in the previous frame are not drawn, needs indirect draws
+	void setOcclusionCulling(bool newOcclusionCulling);
+	// The depth of the objects is drawn first so the PBR shading only runs for the visible fragments
+	void setDepthPrepass(bool newDepthPrepass);
+	// The renderer's own resources stay resident, the application frees the ones it can drop (streamed textures, caches) when a heap is full
+	void setEvictionCallback(EvictionCallback callback, void* userData);
 	int start();
 private:
 	void run();
@@ -207,7 +330,7 @@ private:
 		std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
 		if (!file.is_open()) {
-			throw std::runtime_error("Failed to open file!");
+			throw std::runtime_error("Failed to open file " + filename + "!");
 		}
 
 		size_t fileSize = (size_t)file.tellg();
@@ -241,6 +364,26 @@ private:
 		app->framebufferResized = true;
 	}
 
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+		auto app = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+		if (key == GLFW_KEY_F12 && action == GLFW_PRESS) {
+			app->memoryAllocator.dumpStats(MEMORY_STATS_PATH);
+			std::cout << "Memory statistics written to " << MEMORY_STATS_PATH << std::endl;
+		}
+		if (key == GLFW_KEY_F11 && action == GLFW_PRESS) {
+			app->indirectDraw = !app->indirectDraw;
+			std::cout << "Indirect draw " << (app->indirectDraw ? "enabled" : "disabled") << std::endl;
+		}
+		if (key == GLFW_KEY_F10 && action == GLFW_PRESS) {
+			app->occlusionCulling = !app->occlusionCulling;
+			std::cout << "Occlusion culling " << (app->occlusionCulling ? "enabled" : "disabled") << std::endl;
+		}
+		if (key == GLFW_KEY_F9 && action == GLFW_PRESS) {
+			app->depthPrepass = !app->depthPrepass;
+			std::cout << "Depth pre-pass " << (app->depthPrepass ? "enabled" : "disabled") << std::endl;
+		}
+	}
+
 	void initVulkan();
 	void createInstance();
 	void setupDebugMessenger();
@@ -267,23 +410,51 @@ private:
 	void createRenderingCommandBuffers();
 	void createSyncObjects();
 	void recordRenderingCommandBuffer(uint32_t imageIndex);
+	void recordSecondaryCommandBuffers(RecordedCommands& frameCommands);
+	uint64_t getDrawStateHash();
+	void invalidateRecordedCommands();
+	VkCommandBuffer beginSecondaryCommandBuffer(RecordingCommandPool& recordingCommandPool, VkRenderPass secondaryRenderPass, VkFramebuffer framebuffer, VkCommandBufferUsageFlags flags);
+	void recordShadowsPass(VkCommandBuffer commandBuffer, int light);
+	void recordObjectsPass(VkCommandBuffer commandBuffer, uint32_t view, uint32_t firstDraw, uint32_t drawCount);
+	void recordDepthPrepass(VkCommandBuffer commandBuffer, uint32_t view, uint32_t firstDraw, uint32_t drawCount);
 	VkShaderModule createShaderModule(const std::vector<char>& code);
 	bool isDeviceSuitable(VkPhysicalDevice device);
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+	bool checkOptionalDeviceExtensionSupport(VkPhysicalDevice device, const char* extension);
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
 	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
-	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image);
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-	void updateUniformBuffer(Object* obj, uint32_t currentImage);
+	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation*& imageAllocation, bool movable);
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, Allocation*& bufferAllocation);
+	void copyBuffer(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+	uint64_t getDrawKey(Object* obj);
+	void sortDrawList();
+	void updateDrawList(uint32_t frame);
+	void buildDrawGroups(const uint8_t* visibility, uint32_t firstInstance, std::vector<DrawGroup>& groups);
+	void updateInstanceBuffer(uint32_t frame);
+	void updateIndirectBuffer(uint32_t frame);
+	void drawIndirect(VkCommandBuffer commandBuffer, uint32_t view, uint32_t batch, uint32_t firstDraw, uint32_t drawCount);
+	void extractFrustumPlanes(glm::mat4 viewProj, glm::vec4* planes);
+	void createCullingPipeline();
+	void updateCullingDescriptorSets(uint32_t frame);
+	void recordCullingPass(VkCommandBuffer commandBuffer);
+	void recordOcclusionCullingPass(VkCommandBuffer commandBuffer);
+	void recordCullingSteps(VkCommandBuffer commandBuffer, uint32_t firstView, uint32_t viewCount);
+	bool isOcclusionCullingActive();
+	void createDepthPyramidResources();
+	void createDepthPyramidPipelines();
+	void updateDepthPyramidDescriptorSets();
+	void recordDepthPyramid(VkCommandBuffer commandBuffer);
+	void updateUniformBuffer(Object* obj);
+	void updateObjectBuffer(uint32_t frame);
+	uint32_t getObjectBufferOffset(uint32_t frame);
+	void updateFrameBuffers();
 	VkCommandBuffer beginSingleTimeCommands();
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, uint32_t layers);
-	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layers);
+	void copyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t layers);
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
 	VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 	VkFormat findDepthFormat();
@@ -298,15 +469,20 @@ private:
 	void createSkyboxTextureSampler();
 	void loadModelFromFile(Model* model);
 	void loadModelFromList(Model* model);
+	void computeMeshBounds(const std::vector<Vertex>& meshVertices, const std::vector<uint32_t>& meshIndices, float* aabbMin, float* aabbMax, float* boundingSphere);
 	void loadSkyboxModel();
 	void createPBRGraphicsPipeline();
 	void createSkyboxGraphicsPipeline();
 	void createShadowsGraphicsPipeline();
+	void createDepthPrepassGraphicsPipeline();
 	void createVertexBuffer();
 	void createIndexBuffer();
-	void updateDescriptorSets(Object* obj, int frame);
+	void updateDescriptorSets(uint32_t frame);
+	void updateMaterialDescriptorSets(Material* mat, uint32_t frame);
 	void updateSkyboxDescriptorSets(int frame);
-	void updateShadowsDescriptorSets(Object* obj, int frame);
+	void updateShadowsDescriptorSets(uint32_t frame);
+	void defragmentMemory(VkCommandBuffer commandBuffer);
+	bool updateMovedTextures(Material* mat, uint32_t frame);
 	void mainLoop();
 	void drawFrame();
 	void cleanup();
@@ -316,8 +492,16 @@ private:
 	VkDebugUtilsMessengerEXT debugMessenger;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	VkDevice device;
+	bool memoryBudgetSupported = false;
+	// Without multiDrawIndirect, indirect draws are submitted one at a time
+	uint32_t maxDrawIndirectCount = 1;
+	// Without drawIndirectCount, culled draws are kept with no instance instead of being compacted
+	bool drawIndirectCountSupported = false;
+	// With depthClamp, shadow casters between a directional light and its near plane are clamped to it instead of being clipped
+	bool depthClampSupported = false;
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+	VulkanMemoryBackend memoryBackend;
 	MemoryAllocator memoryAllocator;
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swapChain;
@@ -328,15 +512,24 @@ private:
 	VkRenderPass renderPass;
 	VkRenderPass shadowsRenderPass;
 	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorSetLayout materialDescriptorSetLayout;
 	VkDescriptorSetLayout skyboxDescriptorSetLayout;
 	VkDescriptorSetLayout shadowsDescriptorSetLayout;
 	int skyboxGraphicsPipelineIndex;
 	int shadowsGraphicsPipelineIndex;
+	int pbrGraphicsPipelineIndex;
+	// PBR pipeline testing for equality with the depth written by the depth pre-pass, without writing it
+	int pbrDepthEqualGraphicsPipelineIndex;
+	int depthPrepassGraphicsPipelineIndex;
+	bool depthPrepass = false;
 	std::vector<VkPipeline> graphicsPipelines;
 	std::vector<VkPipelineLayout> graphicsPipelineLayouts;
 	std::vector<VkFramebuffer> swapChainFramebuffers;
 	std::vector<std::vector<VkFramebuffer>> shadowsFramebuffers;
-	std::vector<VkCommandPool> renderingCommandPools;
+	// Command pool of each swapchain image for its primary command buffer and skybox secondary command buffer
+	std::vector<RecordingCommandPool> renderingCommandPools;
+	std::array<RecordedCommands, MAX_FRAMES_IN_FLIGHT> recordedCommands;
+	ThreadPool recordingThreads;
 	VkCommandPool singleTimeCommandPool;
 	std::vector<VkCommandBuffer> renderingCommandBuffers;
 	std::vector<VkSemaphore> imageAvailableSemaphores;
@@ -349,36 +542,122 @@ private:
 	VkDescriptorPool shadowsDescriptorPool;
 	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 	VkImage colorImage;
+	Allocation* colorImageAllocation;
 	VkImageView colorImageView;
 	VkImage depthImage;
+	Allocation* depthImageAllocation;
 	VkImageView depthImageView;
 	VkImage skyboxImage;
+	Allocation* skyboxImageAllocation;
 	VkImageView skyboxImageView;
 	VkSampler skyboxSampler;
 	std::vector<VkImage> shadowsImages;
+	std::vector<Allocation*> shadowsImageAllocations;
 	std::vector<VkImageView> shadowsImageViews;
 	VkSampler shadowsSampler;
 	std::vector<Vertex> vertices;
-	VkBuffer vertexBuffer;
+	Allocation* vertexBufferAllocation;
 	std::vector<uint32_t> indices;
-	VkBuffer indexBuffer;
+	Allocation* indexBufferAllocation;
 	VkDeviceSize vertexSize = 0;
 	VkDeviceSize indexSize = 0;
 
+	// Every object's data for each frame in flight, the frame's region is selected with a dynamic offset
+	Allocation* objectBufferAllocation;
+	// Size of a frame's region, aligned to minStorageBufferOffsetAlignment
+	VkDeviceSize objectBufferFrameSize;
+	// Objects' data computed when their transform changed and version of each object in each frame's region
+	std::vector<ObjectBufferObject> objectBufferData;
+	std::vector<std::vector<uint64_t>> objectBufferVersions;
+
+	// Draws of the main and shadows passes, rebuilt every frame from the sorted draw list
+	std::vector<DrawItem> drawList;
+	std::vector<DrawItem> drawListScratch;
+	std::vector<DrawGroup> drawGroups;
+	// Without indirect draws the objects are culled on the CPU, each view (camera then lights) only draws its visible objects
+	FrustumCuller frustumCuller;
+	std::vector<uint8_t> objectVisibility;
+	std::vector<std::vector<DrawGroup>> viewDrawGroups;
+	// Object index of each instance for each frame in flight, written by the culling pass for each view with indirect draws
+	Allocation* instanceBufferAllocation;
+	VkDeviceSize instanceBufferFrameSize;
+	// One command per mesh of each group and view for each frame in flight, written by the culling pass
+	bool indirectDraw = true;
+	Allocation* indirectBufferAllocation;
+	VkDeviceSize indirectBufferFrameSize;
+	uint32_t indirectDrawCount = 0;
+	std::vector<IndirectBatch> indirectBatches;
+
+	// Culling pass, tests every instance against the camera and shadow casters' frustums
+	VkPipeline cullingPipeline;
+	VkPipelineLayout cullingPipelineLayout;
+	VkDescriptorSetLayout cullingDescriptorSetLayout;
+	VkDescriptorPool cullingDescriptorPool;
+	std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> cullingDescriptorSets;
+	CullingBufferObject cullingBufferObject;
+	uint32_t cullingBufferOffset;
+	uint32_t cullingViewCount = 1;
+	uint32_t cullingInstanceCount = 0;
+	// Draws and instances to cull, written every frame
+	Allocation* cullingDrawBufferAllocation;
+	VkDeviceSize cullingDrawBufferFrameSize;
+	Allocation* cullingInstanceBufferAllocation;
+	VkDeviceSize cullingInstanceBufferFrameSize;
+	// Draw count of each batch and view then instance count of each draw and view, cleared every frame
+	Allocation* cullingCountBufferAllocation;
+	VkDeviceSize cullingCountBufferFrameSize;
+
+	// Occlusion culling in two phases, the objects visible in the previous frame are drawn then every object is tested against their depth
+	// The ones found visible that were not drawn are drawn in a second main pass
+	bool occlusionCulling = true;
+	// Needs the depth image to be sampled by the depth pyramid pass
+	bool occlusionCullingSupported = false;
+	VkRenderPass occlusionRenderPass = VK_NULL_HANDLE;
+	// Alternates every frame between the two visibility entries of each object
+	uint32_t occlusionParity = 0;
+	// Visibility of each object for the previous and current frames, device local
+	Allocation* visibilityBufferAllocation;
+	VkDeviceSize visibilityBufferSize;
+	// Farthest depth of the camera's depth image, each level covers 2x2 texels of the previous one
+	VkImage depthPyramidImage;
+	Allocation* depthPyramidImageAllocation;
+	VkImageView depthPyramidImageView;
+	std::vector<VkImageView> depthPyramidLevelViews;
+	VkSampler depthPyramidSampler;
+	uint32_t depthPyramidWidth;
+	uint32_t depthPyramidHeight;
+	uint32_t depthPyramidLevels;
+	// The first level is copied from the depth image, the others are built from the previous level
+	VkPipeline depthPyramidDepthPipeline;
+	VkPipeline depthPyramidPipeline;
+	VkPipelineLayout depthPyramidPipelineLayout;
+	VkDescriptorSetLayout depthPyramidDescriptorSetLayout;
+	VkDescriptorPool depthPyramidDescriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> depthPyramidDescriptorSets;
+
+	// Materials of the scene, in index order
+	std::vector<Material*> materials;
+
+	// Buffers only use dynamic offsets so one set is bound for every object of a pass
+	// One set per frame in flight so a frame can update its sets while the previous one is executed
+	std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> descriptorSets;
+	std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> shadowsDescriptorSets;
+
 	// Skybox
-	std::vector<VkBuffer> skyboxBuffers;
-	std::vector<VkDeviceMemory> skyboxBufferMemories;
 	std::vector<VkDescriptorSet> skyboxDescriptorSets;
 	VkDeviceSize skyboxVertexOffset;
 	VkDeviceSize skyboxIndexOffset;
 	VkDeviceSize skyboxIndexSize;
 
-	std::vector<VkBuffer> cameraBuffers;
-	std::vector<VkBuffer> lightsBuffers;
-	std::vector<VkBuffer> shadowsBuffers;
-	std::vector<VkDeviceMemory> cameraBuffersMemory;
-	std::vector<VkDeviceMemory> lightsBuffersMemory;
-	std::vector<VkDeviceMemory> shadowsBuffersMemory;
+	// Dynamic offsets in the ring buffer for the current frame
+	uint32_t cameraBufferOffset;
+	uint32_t lightsBufferOffset;
+	uint32_t shadowsBufferOffset;
+
+	// Resources moved by the defragmentation, each frame in flight updates its descriptor sets when it begins
+	std::array<MovedResources, MAX_FRAMES_IN_FLIGHT> movedResources;
+	// Views of the previous images of moved textures, destroyed once the frame that moved them is done
+	std::array<std::vector<VkImageView>, MAX_FRAMES_IN_FLIGHT> movedImageViews;
 
 	// Size
 	int width = 1280;
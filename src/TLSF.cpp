@@ -0,0 +1,322 @@
+#include "TLSF.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the most significant bit
+static uint32_t bitScanReverse(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (uint32_t)index;
+#else
+	return 63 - (uint32_t)__builtin_clzll(value);
+#endif
+}
+
+// Index of the least significant bit
+static uint32_t bitScanForward(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return (uint32_t)index;
+#else
+	return (uint32_t)__builtin_ctzll(value);
+#endif
+}
+
+// Alignments are always powers of two
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+TLSF::TLSF(uint64_t tlsfSize) {
+	size = tlsfSize;
+	usedSize = 0;
+
+	flBitmap = 0;
+	for (uint32_t i = 0; i < TLSF_FL_INDEX_COUNT; i++) {
+		slBitmaps[i] = 0;
+		for (uint32_t j = 0; j < TLSF_SL_INDEX_COUNT; j++) {
+			freeLists[i][j] = nullptr;
+		}
+	}
+
+	// The whole space is one free block
+	head = newBlock();
+	head->offset = 0;
+	head->size = size;
+	insertFreeBlock(head);
+}
+
+TLSF::~TLSF() {
+	Block* curr;
+	while (head) {
+		curr = head;
+		head = head->nextPhysical;
+		delete curr;
+	}
+
+	for (Block* block : unusedBlocks) {
+		delete block;
+	}
+}
+
+Block* TLSF::allocate(uint64_t allocationSize, uint64_t alignment) {
+	if (allocationSize == 0) {
+		allocationSize = 1;
+	}
+	if (alignment == 0) {
+		alignment = 1;
+	}
+
+	Block* block = findFreeBlock(allocationSize, alignment);
+	if (!block) {
+		return nullptr;
+	}
+	removeFreeBlock(block);
+
+	uint64_t alignedOffset = alignUp(block->offset, alignment);
+	uint64_t padding = alignedOffset - block->offset;
+
+	// Big alignment paddings are given back as a free block
+	if (padding >= TLSF_MIN_BLOCK_SIZE) {
+		Block* paddingBlock = newBlock();
+		paddingBlock->offset = block->offset;
+		paddingBlock->size = padding;
+		paddingBlock->prevPhysical = block->prevPhysical;
+		paddingBlock->nextPhysical = block;
+		if (block->prevPhysical) {
+			block->prevPhysical->nextPhysical = paddingBlock;
+		}
+		else {
+			head = paddingBlock;
+		}
+		block->prevPhysical = paddingBlock;
+		block->offset = alignedOffset;
+		block->size -= padding;
+		padding = 0;
+
+		insertFreeBlock(paddingBlock);
+	}
+	block->padding = padding;
+
+	// Subdivide the block if the remaining space is big enough to be used later
+	uint64_t remainingSize = block->size - padding - allocationSize;
+	if (remainingSize >= TLSF_MIN_BLOCK_SIZE) {
+		Block* remainingBlock = newBlock();
+		remainingBlock->offset = block->offset + padding + allocationSize;
+		remainingBlock->size = remainingSize;
+		remainingBlock->prevPhysical = block;
+		remainingBlock->nextPhysical = block->nextPhysical;
+		if (block->nextPhysical) {
+			block->nextPhysical->prevPhysical = remainingBlock;
+		}
+		block->nextPhysical = remainingBlock;
+		block->size -= remainingSize;
+
+		insertFreeBlock(remainingBlock);
+	}
+
+	block->inUse = true;
+	usedSize += block->size;
+
+	return block;
+}
+
+void TLSF::free(Block* block) {
+	usedSize -= block->size;
+	block->inUse = false;
+	block->padding = 0;
+
+	// Merge with the previous block
+	Block* prev = block->prevPhysical;
+	if (prev && !prev->inUse) {
+		removeFreeBlock(prev);
+		prev->size += block->size;
+		prev->nextPhysical = block->nextPhysical;
+		if (block->nextPhysical) {
+			block->nextPhysical->prevPhysical = prev;
+		}
+		deleteBlock(block);
+		block = prev;
+	}
+
+	// Merge with the next block
+	Block* next = block->nextPhysical;
+	if (next && !next->inUse) {
+		removeFreeBlock(next);
+		block->size += next->size;
+		block->nextPhysical = next->nextPhysical;
+		if (next->nextPhysical) {
+			next->nextPhysical->prevPhysical = block;
+		}
+		deleteBlock(next);
+	}
+
+	insertFreeBlock(block);
+}
+
+uint64_t TLSF::getSize() {
+	return size;
+}
+
+uint64_t TLSF::getUsedSize() {
+	return usedSize;
+}
+
+bool TLSF::isEmpty() {
+	return usedSize == 0;
+}
+
+Block* TLSF::getFirstBlock() {
+	return head;
+}
+
+void TLSF::mappingInsert(uint64_t blockSize, uint32_t* fl, uint32_t* sl) {
+	if (blockSize < TLSF_SMALL_BLOCK_SIZE) {
+		*fl = 0;
+		*sl = (uint32_t)(blockSize / (TLSF_SMALL_BLOCK_SIZE / TLSF_SL_INDEX_COUNT));
+	}
+	else {
+		uint32_t f = bitScanReverse(blockSize);
+		*sl = (uint32_t)(blockSize >> (f - TLSF_SL_INDEX_COUNT_LOG2)) ^ (1U << TLSF_SL_INDEX_COUNT_LOG2);
+		*fl = f - (TLSF_FL_INDEX_SHIFT - 1);
+	}
+}
+
+void TLSF::mappingSearch(uint64_t blockSize, uint32_t* fl, uint32_t* sl) {
+	// Round up to the next list so that every block in it is big enough, small lists are 8 bytes apart
+	if (blockSize >= TLSF_SMALL_BLOCK_SIZE) {
+		blockSize += (1ULL << (bitScanReverse(blockSize) - TLSF_SL_INDEX_COUNT_LOG2)) - 1;
+	}
+	else {
+		blockSize += (TLSF_SMALL_BLOCK_SIZE / TLSF_SL_INDEX_COUNT) - 1;
+	}
+	mappingInsert(blockSize, fl, sl);
+}
+
+Block* TLSF::searchSuitableBlock(uint32_t* fl, uint32_t* sl) {
+	if (*fl >= TLSF_FL_INDEX_COUNT) {
+		return nullptr;
+	}
+
+	// Look in the current first level for a list at least as big
+	uint32_t slMap = slBitmaps[*fl] & (~0U << *sl);
+	if (!slMap) {
+		// Look in the next first levels
+		if (*fl + 1 >= TLSF_FL_INDEX_COUNT) {
+			return nullptr;
+		}
+		uint64_t flMap = flBitmap & (~0ULL << (*fl + 1));
+		if (!flMap) {
+			return nullptr;
+		}
+		*fl = bitScanForward(flMap);
+		slMap = slBitmaps[*fl];
+	}
+	*sl = bitScanForward(slMap);
+
+	return freeLists[*fl][*sl];
+}
+
+Block* TLSF::findFreeBlock(uint64_t allocationSize, uint64_t alignment) {
+	uint32_t fl, sl;
+
+	// First try without the alignment, the head of the list may already be aligned
+	mappingSearch(allocationSize, &fl, &sl);
+	Block* block = searchSuitableBlock(&fl, &sl);
+	if (block && alignUp(block->offset, alignment) + allocationSize <= block->offset + block->size) {
+		return block;
+	}
+
+	if (alignment > 1) {
+		// Blocks of this size can hold the aligned allocation
+		mappingSearch(allocationSize + alignment - 1, &fl, &sl);
+		block = searchSuitableBlock(&fl, &sl);
+		if (block && alignUp(block->offset, alignment) + allocationSize <= block->offset + block->size) {
+			return block;
+		}
+	}
+
+	// Blocks in the allocation's own list can still be big enough, like a block exactly the size of the allocation
+	mappingInsert(allocationSize, &fl, &sl);
+	if (fl >= TLSF_FL_INDEX_COUNT) {
+		return nullptr;
+	}
+	for (block = freeLists[fl][sl]; block; block = block->nextFree) {
+		if (alignUp(block->offset, alignment) + allocationSize <= block->offset + block->size) {
+			return block;
+		}
+	}
+
+	return nullptr;
+}
+
+void TLSF::insertFreeBlock(Block* block) {
+	uint32_t fl, sl;
+	mappingInsert(block->size, &fl, &sl);
+
+	block->prevFree = nullptr;
+	block->nextFree = freeLists[fl][sl];
+	if (block->nextFree) {
+		block->nextFree->prevFree = block;
+	}
+	freeLists[fl][sl] = block;
+
+	flBitmap |= (1ULL << fl);
+	slBitmaps[fl] |= (1U << sl);
+}
+
+void TLSF::removeFreeBlock(Block* block) {
+	uint32_t fl, sl;
+	mappingInsert(block->size, &fl, &sl);
+
+	if (block->prevFree) {
+		block->prevFree->nextFree = block->nextFree;
+	}
+	else {
+		freeLists[fl][sl] = block->nextFree;
+	}
+	if (block->nextFree) {
+		block->nextFree->prevFree = block->prevFree;
+	}
+	block->prevFree = nullptr;
+	block->nextFree = nullptr;
+
+	// Update bitmaps if the list is now empty
+	if (!freeLists[fl][sl]) {
+		slBitmaps[fl] &= ~(1U << sl);
+		if (!slBitmaps[fl]) {
+			flBitmap &= ~(1ULL << fl);
+		}
+	}
+}
+
+Block* TLSF::newBlock() {
+	Block* block;
+	if (!unusedBlocks.empty()) {
+		block = unusedBlocks.back();
+		unusedBlocks.pop_back();
+	}
+	else {
+		block = new Block();
+	}
+
+	block->prevPhysical = nullptr;
+	block->nextPhysical = nullptr;
+	block->prevFree = nullptr;
+	block->nextFree = nullptr;
+	block->offset = 0;
+	block->size = 0;
+	block->padding = 0;
+	block->inUse = false;
+	block->userData = nullptr;
+
+	return block;
+}
+
+void TLSF::deleteBlock(Block* block) {
+	unusedBlocks.push_back(block);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Second level subdivisions (32 lists per power of two)
+#define TLSF_SL_INDEX_COUNT_LOG2 5
+#define TLSF_SL_INDEX_COUNT (1 << TLSF_SL_INDEX_COUNT_LOG2)
+// Sizes under 256 bytes are all stored in the first level 0
+#define TLSF_FL_INDEX_SHIFT (TLSF_SL_INDEX_COUNT_LOG2 + 3)
+#define TLSF_SMALL_BLOCK_SIZE (1ULL << TLSF_FL_INDEX_SHIFT)
+#define TLSF_FL_INDEX_COUNT (64 - TLSF_FL_INDEX_SHIFT + 1)
+// Remainders smaller than this stay inside the allocated block
+#define TLSF_MIN_BLOCK_SIZE 256
+
+struct Block {
+	// Neighbours in memory
+	Block* prevPhysical;
+	Block* nextPhysical;
+
+	// Neighbours in the free list (only when the block is free)
+	Block* prevFree;
+	Block* nextFree;
+
+	uint64_t offset;
+	uint64_t size;
+	// Bytes lost at the beginning of the block to respect the alignment
+	uint64_t padding;
+	bool inUse;
+	// Owner of the block, set by the user of the allocator
+	void* userData;
+};
+
+// Two-Level Segregated Fit sub-allocator
+// Allocation and deallocation are O(1), free neighbours are merged on deallocation
+class TLSF {
+public:
+	TLSF(uint64_t tlsfSize);
+	~TLSF();
+	TLSF(const TLSF&) = delete;
+	TLSF& operator=(const TLSF&) = delete;
+
+	Block* allocate(uint64_t allocationSize, uint64_t alignment);
+	void free(Block* block);
+
+	uint64_t getSize();
+	uint64_t getUsedSize();
+	bool isEmpty();
+	Block* getFirstBlock();
+private:
+	void mappingInsert(uint64_t blockSize, uint32_t* fl, uint32_t* sl);
+	void mappingSearch(uint64_t blockSize, uint32_t* fl, uint32_t* sl);
+	Block* searchSuitableBlock(uint32_t* fl, uint32_t* sl);
+	Block* findFreeBlock(uint64_t allocationSize, uint64_t alignment);
+	void insertFreeBlock(Block* block);
+	void removeFreeBlock(Block* block);
+	Block* newBlock();
+	void deleteBlock(Block* block);
+
+	uint64_t size;
+	uint64_t usedSize;
+
+	uint64_t flBitmap;
+	uint32_t slBitmaps[TLSF_FL_INDEX_COUNT];
+	Block* freeLists[TLSF_FL_INDEX_COUNT][TLSF_SL_INDEX_COUNT];
+
+	Block* head;
+
+	// Recycled block descriptors
+	std::vector<Block*> unusedBlocks;
+};
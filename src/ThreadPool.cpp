@@ -0,0 +1,105 @@
+#include "ThreadPool.h"
+
+ThreadPool::~ThreadPool() {
+	stop();
+}
+
+void ThreadPool::start(uint32_t newThreadCount) {
+	stop();
+	stopping = false;
+	threadCount = newThreadCount > 0 ? newThreadCount : 1;
+	for (uint32_t i = 1; i < threadCount; i++) {
+		threads.push_back(std::thread(&ThreadPool::work, this, i));
+	}
+}
+
+void ThreadPool::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	startCondition.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+	threadCount = 1;
+}
+
+uint32_t ThreadPool::getThreadCount() {
+	return threadCount;
+}
+
+void ThreadPool::run(uint32_t count, const std::function<void(uint32_t, uint32_t)>& task) {
+	if (count == 0) {
+		return;
+	}
+
+	// Not worth waking the threads up for a single task
+	if (threads.empty() || count == 1) {
+		for (uint32_t i = 0; i < count; i++) {
+			task(i, 0);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentTask = &task;
+		taskCount = count;
+		nextTask = 0;
+		exception = nullptr;
+		workingThreads = static_cast<uint32_t>(threads.size());
+		generation++;
+	}
+	startCondition.notify_all();
+
+	runTasks(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this] { return workingThreads == 0; });
+	currentTask = nullptr;
+	if (exception) {
+		std::exception_ptr taskException = exception;
+		exception = nullptr;
+		std::rethrow_exception(taskException);
+	}
+}
+
+void ThreadPool::work(uint32_t thread) {
+	uint64_t lastGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			startCondition.wait(lock, [this, lastGeneration] { return stopping || generation != lastGeneration; });
+			if (stopping) {
+				return;
+			}
+			lastGeneration = generation;
+		}
+
+		runTasks(thread);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			workingThreads--;
+		}
+		doneCondition.notify_one();
+	}
+}
+
+void ThreadPool::runTasks(uint32_t thread) {
+	// Tasks are taken one at a time so threads finishing early take more of them
+	uint32_t index;
+	while ((index = nextTask.fetch_add(1)) < taskCount) {
+		try {
+			(*currentTask)(index, thread);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!exception) {
+				exception = std::current_exception();
+			}
+		}
+	}
+}
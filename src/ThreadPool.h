@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+// Threads waiting for work, each run splits tasks between them and the calling thread
+// Threads are numbered from 1, the calling thread being thread 0, so tasks can use per-thread resources
+class ThreadPool {
+public:
+	~ThreadPool();
+	// Thread count includes the calling thread
+	void start(uint32_t newThreadCount);
+	void stop();
+	uint32_t getThreadCount();
+	// Calls task(index, thread) for every index in [0, count) and returns when they are done, rethrows the first exception thrown by a task
+	void run(uint32_t count, const std::function<void(uint32_t, uint32_t)>& task);
+private:
+	void work(uint32_t thread);
+	void runTasks(uint32_t thread);
+
+	std::vector<std::thread> threads;
+	uint32_t threadCount = 1;
+	std::mutex mutex;
+	std::condition_variable startCondition;
+	std::condition_variable doneCondition;
+	// Changes every run so waiting threads know there is new work
+	uint64_t generation = 0;
+	uint32_t workingThreads = 0;
+	bool stopping = false;
+
+	const std::function<void(uint32_t, uint32_t)>* currentTask = nullptr;
+	uint32_t taskCount = 0;
+	std::atomic<uint32_t> nextTask{ 0 };
+	std::exception_ptr exception;
+};
@@ -0,0 +1,126 @@
+#include "VulkanMemoryBackend.h"
+
+void VulkanMemoryBackend::setDevice(VkDevice* newDevice) {
+	device = newDevice;
+}
+
+void VulkanMemoryBackend::setPhysicalDevice(VkPhysicalDevice* newPhysicalDevice) {
+	physicalDevice = newPhysicalDevice;
+}
+
+void VulkanMemoryBackend::setMemoryBudgetSupported(bool newMemoryBudgetSupported) {
+	memoryBudgetSupported = newMemoryBudgetSupported;
+}
+
+VkResult VulkanMemoryBackend::allocateMemory(const VkMemoryAllocateInfo* allocInfo, VkDeviceMemory* memory) {
+	return vkAllocateMemory(*device, allocInfo, nullptr, memory);
+}
+
+void VulkanMemoryBackend::freeMemory(VkDeviceMemory memory) {
+	vkFreeMemory(*device, memory, nullptr);
+}
+
+VkResult VulkanMemoryBackend::mapMemory(VkDeviceMemory memory, void** data) {
+	return vkMapMemory(*device, memory, 0, VK_WHOLE_SIZE, 0, data);
+}
+
+void VulkanMemoryBackend::unmapMemory(VkDeviceMemory memory) {
+	vkUnmapMemory(*device, memory);
+}
+
+VkResult VulkanMemoryBackend::createBuffer(const VkBufferCreateInfo* bufferInfo, VkBuffer* buffer) {
+	return vkCreateBuffer(*device, bufferInfo, nullptr, buffer);
+}
+
+void VulkanMemoryBackend::destroyBuffer(VkBuffer buffer) {
+	vkDestroyBuffer(*device, buffer, nullptr);
+}
+
+void VulkanMemoryBackend::getBufferMemoryRequirements(VkBuffer buffer, VkMemoryRequirements* memRequirements) {
+	vkGetBufferMemoryRequirements(*device, buffer, memRequirements);
+}
+
+VkResult VulkanMemoryBackend::bindBufferMemory(VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset) {
+	return vkBindBufferMemory(*device, buffer, memory, offset);
+}
+
+VkResult VulkanMemoryBackend::createImage(const VkImageCreateInfo* imageInfo, VkImage* image) {
+	return vkCreateImage(*device, imageInfo, nullptr, image);
+}
+
+void VulkanMemoryBackend::destroyImage(VkImage image) {
+	vkDestroyImage(*device, image, nullptr);
+}
+
+void VulkanMemoryBackend::getImageMemoryRequirements(VkImage image, VkMemoryRequirements* memRequirements) {
+	vkGetImageMemoryRequirements(*device, image, memRequirements);
+}
+
+VkResult VulkanMemoryBackend::bindImageMemory(VkImage image, VkDeviceMemory memory, VkDeviceSize offset) {
+	return vkBindImageMemory(*device, image, memory, offset);
+}
+
+bool VulkanMemoryBackend::prefersDedicatedBuffer(VkBuffer buffer) {
+	VkBufferMemoryRequirementsInfo2 requirementsInfo = {};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.buffer = buffer;
+
+	VkMemoryDedicatedRequirements dedicatedRequirements = {};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 memRequirements = {};
+	memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	memRequirements.pNext = &dedicatedRequirements;
+	vkGetBufferMemoryRequirements2(*device, &requirementsInfo, &memRequirements);
+
+	return dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+}
+
+bool VulkanMemoryBackend::prefersDedicatedImage(VkImage image) {
+	VkImageMemoryRequirementsInfo2 requirementsInfo = {};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.image = image;
+
+	VkMemoryDedicatedRequirements dedicatedRequirements = {};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 memRequirements = {};
+	memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	memRequirements.pNext = &dedicatedRequirements;
+	vkGetImageMemoryRequirements2(*device, &requirementsInfo, &memRequirements);
+
+	return dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+}
+
+bool VulkanMemoryBackend::getMemoryBudget(VkDeviceSize* heapBudgets, VkDeviceSize* heapUsages) {
+	if (!memoryBudgetSupported) {
+		return false;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+	budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	VkPhysicalDeviceMemoryProperties2 memProperties = {};
+	memProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	memProperties.pNext = &budgetProperties;
+	vkGetPhysicalDeviceMemoryProperties2(*physicalDevice, &memProperties);
+
+	for (uint32_t i = 0; i < memProperties.memoryProperties.memoryHeapCount; i++) {
+		heapBudgets[i] = budgetProperties.heapBudget[i];
+		heapUsages[i] = budgetProperties.heapUsage[i];
+	}
+
+	return true;
+}
+
+void VulkanMemoryBackend::cmdCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy* regions) {
+	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, regionCount, regions);
+}
+
+void VulkanMemoryBackend::cmdCopyImage(VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageCopy* regions) {
+	vkCmdCopyImage(commandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, regions);
+}
+
+void VulkanMemoryBackend::cmdPipelineBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, uint32_t memoryBarrierCount, const VkMemoryBarrier* memoryBarriers, uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* imageMemoryBarriers) {
+	vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, memoryBarrierCount, memoryBarriers, 0, nullptr, imageMemoryBarrierCount, imageMemoryBarriers);
+}
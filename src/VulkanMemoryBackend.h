@@ -0,0 +1,37 @@
+#pragma once
+#include "MemoryBackend.h"
+
+// MemoryBackend calling the Vulkan device
+class VulkanMemoryBackend : public MemoryBackend {
+public:
+	void setDevice(VkDevice* newDevice);
+	void setPhysicalDevice(VkPhysicalDevice* newPhysicalDevice);
+	void setMemoryBudgetSupported(bool newMemoryBudgetSupported);
+
+	VkResult allocateMemory(const VkMemoryAllocateInfo* allocInfo, VkDeviceMemory* memory) override;
+	void freeMemory(VkDeviceMemory memory) override;
+	VkResult mapMemory(VkDeviceMemory memory, void** data) override;
+	void unmapMemory(VkDeviceMemory memory) override;
+
+	VkResult createBuffer(const VkBufferCreateInfo* bufferInfo, VkBuffer* buffer) override;
+	void destroyBuffer(VkBuffer buffer) override;
+	void getBufferMemoryRequirements(VkBuffer buffer, VkMemoryRequirements* memRequirements) override;
+	VkResult bindBufferMemory(VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset) override;
+
+	VkResult createImage(const VkImageCreateInfo* imageInfo, VkImage* image) override;
+	void destroyImage(VkImage image) override;
+	void getImageMemoryRequirements(VkImage image, VkMemoryRequirements* memRequirements) override;
+	VkResult bindImageMemory(VkImage image, VkDeviceMemory memory, VkDeviceSize offset) override;
+
+	bool prefersDedicatedBuffer(VkBuffer buffer) override;
+	bool prefersDedicatedImage(VkImage image) override;
+	bool getMemoryBudget(VkDeviceSize* heapBudgets, VkDeviceSize* heapUsages) override;
+
+	void cmdCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy* regions) override;
+	void cmdCopyImage(VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageCopy* regions) override;
+	void cmdPipelineBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, uint32_t memoryBarrierCount, const VkMemoryBarrier* memoryBarriers, uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* imageMemoryBarriers) override;
+private:
+	VkDevice* device;
+	VkPhysicalDevice* physicalDevice;
+	bool memoryBudgetSupported = false;
+};
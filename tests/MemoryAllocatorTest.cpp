@@ -0,0 +1,168 @@
+#include "../benchmarks/MockMemoryBackend.h"
+#include "../src/MemoryAllocator.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+// 16 MB, 16 images fill a chunk
+#define IMAGE_SIZE 16777216
+// 1 MB
+#define MB 1048576
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& message) {
+	if (!condition) {
+		std::cout << "FAILED: " << message << std::endl;
+		failures++;
+	}
+}
+
+// The video memory heap only has space for one chunk and the BAR heap has none
+static void initAllocator(MockMemoryBackend& backend, MemoryAllocator& allocator) {
+	allocator.setBackend(&backend);
+	allocator.setPhysicalDeviceMemoryProperties(backend.getMemoryProperties());
+	allocator.setPhysicalDeviceLimits(backend.getLimits());
+	allocator.setHeapBudget(0, CHUNK_SIZE);
+	allocator.setHeapBudget(2, 1);
+}
+
+static Allocation* allocateImage(MockMemoryBackend& backend, MemoryAllocator& allocator, VkDeviceSize size) {
+	VkMemoryRequirements memRequirements = {};
+	memRequirements.size = size;
+	memRequirements.alignment = 256;
+	memRequirements.memoryTypeBits = 7;
+	VkImage image = backend.createImage(memRequirements);
+
+	return allocator.allocate(&image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+}
+
+// Device local images redirected to system memory must share the redirected chunk
+static void testRedirectedChunk() {
+	MockMemoryBackend backend;
+	MemoryAllocator allocator;
+	initAllocator(backend, allocator);
+
+	std::vector<Allocation*> allocations;
+	for (VkDeviceSize size = 0; size < CHUNK_SIZE; size += IMAGE_SIZE) {
+		allocations.push_back(allocateImage(backend, allocator, IMAGE_SIZE));
+	}
+	check(allocator.getStats().chunkCount == 1, "redirected chunk: video memory chunk not filled");
+
+	Allocation* first = allocateImage(backend, allocator, IMAGE_SIZE);
+	Allocation* second = allocateImage(backend, allocator, IMAGE_SIZE);
+	check(first->chunk->type == 1, "redirected chunk: image not redirected to system memory");
+	check(second->chunk == first->chunk, "redirected chunk: a new chunk has been created for the second image");
+	check(allocator.getStats().chunkCount == 2, "redirected chunk: " + std::to_string(allocator.getStats().chunkCount) + " chunks instead of 2");
+
+	allocations.push_back(first);
+	allocations.push_back(second);
+	for (Allocation* allocation : allocations) {
+		allocator.free(allocation);
+	}
+	allocator.free();
+}
+
+// Resources the eviction callback drops are freed before the next one
+struct EvictionState {
+	MemoryAllocator* allocator;
+	std::vector<Allocation*> allocations;
+	uint32_t calls;
+};
+
+static bool evict(void* userData, uint32_t heap, VkDeviceSize size) {
+	EvictionState* state = (EvictionState*)userData;
+	state->calls++;
+	if (heap != 0 || state->allocations.empty()) {
+		return false;
+	}
+
+	state->allocator->free(state->allocations.back());
+	state->allocations.pop_back();
+	return true;
+}
+
+// A resource that does not fit in the video memory heap's budget makes room by evicting the others
+static void testEviction() {
+	MockMemoryBackend backend;
+	MemoryAllocator allocator;
+	initAllocator(backend, allocator);
+
+	EvictionState state = { &allocator, {}, 0 };
+	allocator.setEvictionCallback(evict, &state);
+	state.allocations.push_back(allocateImage(backend, allocator, IMAGE_SIZE));
+	state.allocations.push_back(allocateImage(backend, allocator, IMAGE_SIZE));
+	check(state.calls == 0, "eviction: callback called while the heap had space");
+
+	// Dedicated, as big as the heap's budget
+	Allocation* allocation = allocateImage(backend, allocator, CHUNK_SIZE);
+	check(state.calls == 2, "eviction: callback called " + std::to_string(state.calls) + " times instead of 2");
+	check(state.allocations.empty(), "eviction: resources not evicted");
+	check(allocation->chunk->type == 0, "eviction: image not in video memory");
+	check(allocator.getStats().chunkCount == 1, "eviction: " + std::to_string(allocator.getStats().chunkCount) + " chunks instead of 1");
+
+	allocator.free(allocation);
+	allocator.free();
+}
+
+// Blocks cached by a thread are not used, they are released when the heap is full
+static void testThreadCache() {
+	MockMemoryBackend backend;
+	MemoryAllocator allocator;
+	initAllocator(backend, allocator);
+
+	allocator.free(allocator.allocate(256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+	MemoryStats stats = allocator.getStats();
+	check(stats.total.cachedSize != 0, "thread cache: cached block not reported");
+	check(stats.total.usedSize == 0 && stats.total.allocationCount == 0, "thread cache: cached block reported as used");
+
+	// Dedicated, only fits once the buffer chunk is released
+	Allocation* allocation = allocateImage(backend, allocator, CHUNK_SIZE - 32 * MB);
+	check(allocation->chunk->type == 0, "thread cache: image not in video memory");
+	check(allocator.getStats().chunkCount == 1, "thread cache: " + std::to_string(allocator.getStats().chunkCount) + " chunks instead of 1");
+
+	allocator.free(allocation);
+	allocator.free();
+}
+
+// Allocations bigger than the limit are not moved
+static void testDefragmentationLimit() {
+	MockMemoryBackend backend;
+	MemoryAllocator allocator;
+	initAllocator(backend, allocator);
+
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	Allocation* kept = allocator.allocate(30 * MB, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	Allocation* freed = allocator.allocate(34 * MB, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	Allocation* big = allocator.allocate(10 * MB, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	Allocation* small = allocator.allocate(MB, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	Chunk* sparseChunk = big->chunk;
+	check(sparseChunk != kept->chunk && small->chunk == sparseChunk, "defragmentation limit: unexpected placement");
+	allocator.free(freed);
+
+	std::vector<Allocation*> movedAllocations;
+	VkDeviceSize movedBytes = allocator.defragment(VK_NULL_HANDLE, 8 * MB, 0, movedAllocations);
+	check(movedBytes <= 8 * MB, "defragmentation limit: " + std::to_string(movedBytes) + " bytes moved");
+	check(big->chunk == sparseChunk, "defragmentation limit: allocation bigger than the limit moved");
+	check(small->chunk == kept->chunk, "defragmentation limit: small allocation not moved");
+	allocator.finishDefragmentation(0);
+
+	allocator.free(kept);
+	allocator.free(big);
+	allocator.free(small);
+	allocator.free();
+}
+
+int main() {
+	testRedirectedChunk();
+	testEviction();
+	testThreadCache();
+	testDefragmentationLimit();
+
+	if (failures) {
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed" << std::endl;
+	return 0;
+}
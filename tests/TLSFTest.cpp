@@ -0,0 +1,81 @@
+#include "../src/TLSF.h"
+#include <iostream>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& message) {
+	if (!condition) {
+		std::cout << "FAILED: " << message << std::endl;
+		failures++;
+	}
+}
+
+// Blocks must cover the whole space without holes or overlaps
+static void checkBlocks(TLSF& tlsf, const std::string& name) {
+	uint64_t offset = 0;
+	for (Block* block = tlsf.getFirstBlock(); block; block = block->nextPhysical) {
+		check(block->offset == offset, name + ": block at " + std::to_string(block->offset) + " instead of " + std::to_string(offset));
+		check(block->size <= tlsf.getSize() - block->offset, name + ": block at " + std::to_string(block->offset) + " goes past the end");
+		offset = block->offset + block->size;
+	}
+	check(offset == tlsf.getSize(), name + ": blocks end at " + std::to_string(offset));
+}
+
+static void checkAllocation(Block* block, uint64_t allocationSize, uint64_t alignment, const std::string& name) {
+	check(block != nullptr, name + ": allocation failed");
+	if (block) {
+		check((block->offset + block->padding) % alignment == 0, name + ": allocation is not aligned");
+		check(block->padding + allocationSize <= block->size, name + ": allocation does not fit in its block");
+	}
+}
+
+// An aligned allocation must not be placed in a free block of the small lists that is too small for it
+static void testSmallAlignedAllocation() {
+	TLSF tlsf(4096);
+	Block* first = tlsf.allocate(256, 1);
+	Block* hole = tlsf.allocate(9, 1);
+	Block* last = tlsf.allocate(256, 1);
+	checkAllocation(first, 256, 1, "small aligned allocation");
+	checkAllocation(hole, 9, 1, "small aligned allocation");
+	checkAllocation(last, 256, 1, "small aligned allocation");
+
+	uint64_t holeOffset = hole->offset;
+	tlsf.free(hole);
+	Block* block = tlsf.allocate(10, 4);
+	checkAllocation(block, 10, 4, "small aligned allocation");
+	if (block) {
+		check(block->offset != holeOffset, "small aligned allocation: placed in the 9 bytes free block");
+	}
+	checkBlocks(tlsf, "small aligned allocation");
+}
+
+// Every small size must only be given blocks that can hold it
+static void testSmallSizes() {
+	for (uint64_t holeSize = 1; holeSize < TLSF_SMALL_BLOCK_SIZE; holeSize++) {
+		for (uint64_t alignment = 1; alignment <= 16; alignment *= 2) {
+			std::string name = "hole of " + std::to_string(holeSize) + " bytes, alignment " + std::to_string(alignment);
+			TLSF tlsf(4096);
+			tlsf.allocate(256, 1);
+			Block* hole = tlsf.allocate(holeSize, 1);
+			tlsf.allocate(256, 1);
+			tlsf.free(hole);
+
+			uint64_t allocationSize = holeSize + 1;
+			checkAllocation(tlsf.allocate(allocationSize, alignment), allocationSize, alignment, name);
+			checkBlocks(tlsf, name);
+		}
+	}
+}
+
+int main() {
+	testSmallAlignedAllocation();
+	testSmallSizes();
+
+	if (failures) {
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed" << std::endl;
+	return 0;
+}